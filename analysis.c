@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <string.h>
+#include "err_codes.h"
+#include "analysis.h"
+
+#define MIN_SLOTS_CAPACITY 64
+
+ANALYSIS_CACHE* analysis_create(void) {
+  ANALYSIS_CACHE *cache = calloc(1, sizeof(ANALYSIS_CACHE));
+  if(cache == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  return cache;
+}
+
+void analysis_free(ANALYSIS_CACHE *cache) {
+  if(cache == NULL)
+    return;
+  for(int i = 0; i < cache->results_num; i++) {
+    snapshot_free(cache->results[i].snapshot);
+    cJSON_Delete(cache->results[i].diagnostics);
+  }
+  free(cache->results);
+  free(cache->slots);
+  free(cache);
+}
+
+FUNCTION_RESULT* analysis_find(ANALYSIS_CACHE *cache, unsigned long key) {
+  if(cache == NULL || cache->slots_capacity == 0 || key == 0)
+    return NULL;
+  int mask = cache->slots_capacity - 1;
+  for(int slot = key & mask; cache->slots[slot] != 0; slot = (slot + 1) & mask) {
+    FUNCTION_RESULT *result = &cache->results[cache->slots[slot] - 1];
+    if(result->key == key)
+      return result;
+  }
+  return NULL;
+}
+
+// Doubles capacity of the slots table.
+static void grow_slots(ANALYSIS_CACHE *cache) {
+  int capacity = cache->slots_capacity ? cache->slots_capacity * 2 : MIN_SLOTS_CAPACITY;
+  int *slots = calloc(capacity, sizeof(int));
+  if(slots == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  for(int i = 0; i < cache->results_num; i++) {
+    int slot = cache->results[i].key & (capacity - 1);
+    while(slots[slot] != 0)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = i + 1;
+  }
+  free(cache->slots);
+  cache->slots = slots;
+  cache->slots_capacity = capacity;
+}
+
+void analysis_move(ANALYSIS_CACHE *cache, FUNCTION_RESULT *result) {
+  if((cache->results_num + 1) * 2 > cache->slots_capacity)
+    grow_slots(cache);
+  if(cache->results_num == cache->results_capacity) {
+    cache->results_capacity = cache->results_capacity ? cache->results_capacity * 2 : 32;
+    cache->results = realloc(cache->results, cache->results_capacity * sizeof(FUNCTION_RESULT));
+    if(cache->results == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+  }
+  cache->results[cache->results_num] = *result;
+  memset(result, 0, sizeof(FUNCTION_RESULT));
+
+  int mask = cache->slots_capacity - 1;
+  int slot = cache->results[cache->results_num].key & mask;
+  while(cache->slots[slot] != 0)
+    slot = (slot + 1) & mask;
+  cache->slots[slot] = ++cache->results_num;
+}
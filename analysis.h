@@ -0,0 +1,50 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <cjson/cJSON.h>
+#include "symtab.h"
+#include "snapshot.h"
+
+/*
+ * Results of checking one top-level function, with lines relative
+ * to its first token. They are reused while the text of the function,
+ * and signatures of the functions before it, are the same.
+ */
+typedef struct {
+  unsigned long key;      // Hash of the text and of the earlier signatures (0 if moved)
+  SYMBOL_ENTRY function;  // Function defined by the text
+  SNAPSHOT *snapshot;     // Its parameters and variables, and occurrences of symbols
+  cJSON *diagnostics;
+} FUNCTION_RESULT;
+
+// Function results of a document, found by key
+typedef struct analysis_cache {
+  FUNCTION_RESULT *results;
+  int results_num;
+  int results_capacity;
+  int *slots;             // Open addressing table: result index + 1, or 0 if empty
+  int slots_capacity;
+} ANALYSIS_CACHE;
+
+/*
+ * Creates an empty cache.
+ */
+ANALYSIS_CACHE* analysis_create(void);
+
+/*
+ * Frees a cache, with all results which were not moved out of it.
+ */
+void analysis_free(ANALYSIS_CACHE *cache);
+
+/*
+ * Returns the result with `key`, or NULL if it is not cached.
+ */
+FUNCTION_RESULT* analysis_find(ANALYSIS_CACHE *cache, unsigned long key);
+
+/*
+ * Moves `result` to the cache, which becomes its owner.
+ * The original is cleared, so it is not found or freed again.
+ */
+void analysis_move(ANALYSIS_CACHE *cache, FUNCTION_RESULT *result);
+
+#endif /* end of include guard: ANALYSIS_H */
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "err_codes.h"
+#include "hash.h"
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE 16384
+#define MIN_STRINGS_CAPACITY 256
+
+ARENA* arena_create(void) {
+  ARENA *arena = calloc(1, sizeof(ARENA));
+  if(arena == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  return arena;
+}
+
+void arena_free(ARENA *arena) {
+  if(arena == NULL)
+    return;
+  while(arena->blocks != NULL) {
+    ARENA_BLOCK *next = arena->blocks->next;
+    free(arena->blocks);
+    arena->blocks = next;
+  }
+  free(arena->strings);
+  free(arena);
+}
+
+void* arena_alloc(ARENA *arena, size_t size) {
+  size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+  ARENA_BLOCK *block = arena->blocks;
+  if(block == NULL || block->size - block->used < size) {
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    block = malloc(sizeof(ARENA_BLOCK) + block_size);
+    if(block == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+    block->used = 0;
+    block->size = block_size;
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  void *memory = block->data + block->used;
+  block->used += size;
+  return memory;
+}
+
+// Doubles capacity of the interned strings table.
+static void grow_strings(ARENA *arena) {
+  size_t capacity = arena->strings_capacity ? arena->strings_capacity * 2 : MIN_STRINGS_CAPACITY;
+  char **strings = calloc(capacity, sizeof(char*));
+  if(strings == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  for(size_t i = 0; i < arena->strings_capacity; i++) {
+    char *string = arena->strings[i];
+    if(string == NULL)
+      continue;
+    size_t slot = hash_bytes(string, strlen(string)) & (capacity - 1);
+    while(strings[slot] != NULL)
+      slot = (slot + 1) & (capacity - 1);
+    strings[slot] = string;
+  }
+  free(arena->strings);
+  arena->strings = strings;
+  arena->strings_capacity = capacity;
+}
+
+char* arena_intern(ARENA *arena, const char *text, size_t length) {
+  if((arena->strings_num + 1) * 2 > arena->strings_capacity)
+    grow_strings(arena);
+
+  size_t slot = hash_bytes(text, length) & (arena->strings_capacity - 1);
+  for(; arena->strings[slot] != NULL; slot = (slot + 1) & (arena->strings_capacity - 1)) {
+    char *string = arena->strings[slot];
+    if(strncmp(string, text, length) == 0 && string[length] == '\0')
+      return string;
+  }
+
+  char *string = arena_alloc(arena, length + 1);
+  memcpy(string, text, length);
+  string[length] = '\0';
+  arena->strings[slot] = string;
+  ++arena->strings_num;
+  return string;
+}
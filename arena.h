@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Block of memory which allocations are carved from
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t used;
+  size_t size;
+  char data[];
+} ARENA_BLOCK;
+
+/*
+ * Bump allocator: memory is allocated from large blocks,
+ * and all of it is released at once when the arena is freed.
+ * Also interns strings, so equal strings share one copy.
+ */
+typedef struct {
+  ARENA_BLOCK *blocks;    // Most recent block first
+  char **strings;         // Open addressing table of interned strings
+  size_t strings_num;
+  size_t strings_capacity;
+} ARENA;
+
+/*
+ * Creates an empty arena.
+ */
+ARENA* arena_create(void);
+
+/*
+ * Frees an arena and everything allocated from it.
+ */
+void arena_free(ARENA *arena);
+
+/*
+ * Allocates `size` bytes, aligned for any type.
+ */
+void* arena_alloc(ARENA *arena, size_t size);
+
+/*
+ * Returns the interned copy of the first `length` characters of `text`.
+ * Equal strings interned in the same arena have the same address.
+ *
+ * WARNING: The result must not be modified.
+ */
+char* arena_intern(ARENA *arena, const char *text, size_t length);
+
+#endif /* end of include guard: ARENA_H */
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+
+FILE *bench_output;
+volatile size_t bench_sink;
+
+static long long now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static long long measure(BENCH_FUNCTION function, void *argument, long iterations) {
+  long long start = now();
+  function(argument, iterations);
+  return now() - start;
+}
+
+static int compare_times(const void *a, const void *b) {
+  double difference = *(const double*) a - *(const double*) b;
+  return (difference > 0) - (difference < 0);
+}
+
+void bench_run(const char *name, long size, BENCH_FUNCTION function, void *argument) {
+  long iterations = 1;
+  while(measure(function, argument, iterations) < BENCH_MIN_TIME && iterations < (1L << 40))
+    iterations *= 2;
+
+  double times[BENCH_RUNS];
+  for(int i = 0; i < BENCH_RUNS; i++)
+    times[i] = (double) measure(function, argument, iterations) / iterations;
+  qsort(times, BENCH_RUNS, sizeof(double), compare_times);
+
+  FILE *output = bench_output != NULL ? bench_output : stdout;
+  fprintf(output, "{\"benchmark\":\"%s\",\"size\":%ld,\"iterations\":%ld,"
+      "\"median_ns\":%.1f,\"min_ns\":%.1f}\n",
+      name, size, iterations, times[BENCH_RUNS / 2], times[0]);
+  fflush(output);
+}
+
+char* bench_source(int functions_num, int locals_num, int *call_line, int *return_line) {
+  char *text;
+  size_t length;
+  FILE *source = open_memstream(&text, &length);
+  if(source == NULL) {
+    perror("open_memstream");
+    exit(EXIT_FAILURE);
+  }
+  int line = 0;
+  for(int i = 0; i < functions_num; i++) {
+    fprintf(source, "int f%d(int p) {\n", i);
+    ++line;
+    for(int j = 0; j < locals_num; j++, line++)
+      fprintf(source, "  int v%d;\n", j);
+    if(i == functions_num / 2 && call_line != NULL)
+      *call_line = line;
+    if(i > 0)
+      fprintf(source, "  v0 = f%d(p) + 1;\n", i - 1);
+    else
+      fprintf(source, "  v0 = p + 1;\n");
+    ++line;
+    for(int j = 1; j < locals_num; j++, line++)
+      fprintf(source, "  v%d = v%d + p;\n", j, j - 1);
+    if(i == functions_num / 2 && return_line != NULL)
+      *return_line = line;
+    fprintf(source, "  return v%d;\n}\n", locals_num - 1);
+    line += 2;
+  }
+  fprintf(source, "int main() {\n  int r;\n  r = f%d(1);\n  return r;\n}\n", functions_num - 1);
+  fclose(source);
+  return text;
+}
@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Minimum duration of a measured run, in nanoseconds
+#define BENCH_MIN_TIME 50000000LL
+// Measured runs of every benchmark
+#define BENCH_RUNS 5
+
+/*
+ * Benchmarked operation: does `iterations` operations on `argument`.
+ */
+typedef void (*BENCH_FUNCTION)(void *argument, long iterations);
+
+// Results are written here, stdout if NULL
+extern FILE *bench_output;
+
+// Benchmarked operations add their results here, so they are not optimized out
+extern volatile size_t bench_sink;
+
+/*
+ * Measures nanoseconds per operation of `function`, and writes the result
+ * as a line of JSON, for comparison across commits:
+ * {"benchmark":name,"size":size,"iterations":...,"median_ns":...,"min_ns":...}
+ * Iterations are doubled until a run takes BENCH_MIN_TIME,
+ * then BENCH_RUNS runs are measured.
+ */
+void bench_run(const char *name, long size, BENCH_FUNCTION function, void *argument);
+
+/*
+ * Returns a miniC source of `functions_num` functions with `locals_num`
+ * local variables each, in which every function calls the previous one.
+ * Stores lines of the call and of the return statement of the middle function,
+ * unless the pointers are NULL.
+ *
+ * WARNING: Caller is responsible to free the result.
+ */
+char* bench_source(int functions_num, int locals_num, int *call_line, int *return_line);
+
+#endif /* end of include guard: BENCH_H */
@@ -0,0 +1,124 @@
+// Micro-benchmarks of reading and writing LSP messages.
+// Sizes are lengths of the messages, in bytes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include "bench.h"
+#include "minic.h"
+#include "lsp.h"
+
+typedef struct {
+  const char *path;       // File the message is read from, as stdin
+  size_t length;
+  cJSON *result;          // Result sent in responses
+} MESSAGE;
+
+static void parse_content(void *argument, long iterations) {
+  MESSAGE *message = argument;
+  if(freopen(message->path, "r", stdin) == NULL) {
+    perror(message->path);
+    exit(EXIT_FAILURE);
+  }
+  for(long i = 0; i < iterations; i++) {
+    rewind(stdin);
+    cJSON *request = lsp_parse_content(message->length);
+    bench_sink += request->type;
+    cJSON_Delete(request);
+  }
+}
+
+static void send_response(void *argument, long iterations) {
+  MESSAGE *message = argument;
+  for(long i = 0; i < iterations; i++)
+    lsp_send_response(1, cJSON_Duplicate(message->result, 1));
+}
+
+// Writes a message to a temporary file, and returns its length.
+static size_t write_message(const char *path, cJSON *message) {
+  char *content = cJSON_PrintUnformatted(message);
+  size_t length = strlen(content);
+  FILE *file = fopen(path, "w");
+  if(file == NULL || fwrite(content, 1, length, file) != length) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  fclose(file);
+  cJSON_free(content);
+  return length;
+}
+
+static cJSON* change_message(const char *text) {
+  cJSON *message = cJSON_CreateObject();
+  cJSON_AddStringToObject(message, "jsonrpc", "2.0");
+  cJSON_AddStringToObject(message, "method", "textDocument/didChange");
+  cJSON *params = cJSON_AddObjectToObject(message, "params");
+  cJSON *document = cJSON_AddObjectToObject(params, "textDocument");
+  cJSON_AddStringToObject(document, "uri", "file:///bench.mc");
+  cJSON_AddNumberToObject(document, "version", 2);
+  cJSON *change = cJSON_CreateObject();
+  cJSON_AddStringToObject(change, "text", text);
+  cJSON_AddItemToArray(cJSON_AddArrayToObject(params, "contentChanges"), change);
+  return message;
+}
+
+int main(void) {
+  // Results are reported to the original stdout, responses are discarded
+  bench_output = fdopen(dup(STDOUT_FILENO), "w");
+  int null = open("/dev/null", O_WRONLY);
+  if(bench_output == NULL || null == -1 || dup2(null, STDOUT_FILENO) == -1) {
+    perror("/dev/null");
+    return EXIT_FAILURE;
+  }
+  close(null);
+
+  char path[] = "/tmp/minic-bench-XXXXXX";
+  int file = mkstemp(path);
+  if(file == -1) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  close(file);
+
+  static const int sizes[] = { 10, 100, 1000 };
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    char *text = bench_source(sizes[i], 8, NULL, NULL);
+    cJSON *change = change_message(text);
+    MESSAGE message = { .path = path, .length = write_message(path, change) };
+    bench_run("lsp_parse_content/didChange", message.length, parse_content, &message);
+    cJSON_Delete(change);
+
+    // Completions of every function, and semantic tokens of the whole text
+    SNAPSHOT *snapshot = parse(NULL, text, strlen(text), NULL);
+    POSITION end = { INT_MAX, 0 };
+    message.result = symbol_completion(snapshot, "f", end);
+    char *content = cJSON_PrintUnformatted(message.result);
+    message.length = strlen(content);
+    cJSON_free(content);
+    bench_run("lsp_send_response/completion", message.length, send_response, &message);
+    cJSON_Delete(message.result);
+
+    TOKEN_STREAM tokens = { 0 };
+    tokens_sync(&tokens, text, strlen(text));
+    size_t data_num;
+    int *data = semantic_tokens(snapshot, tokens.tokens, tokens.tokens_num,
+        (POSITION) { 0, 0 }, end, &data_num);
+    message.result = cJSON_CreateObject();
+    cJSON_AddItemToObject(message.result, "data", semantic_tokens_json(data, data_num));
+    content = cJSON_PrintUnformatted(message.result);
+    message.length = strlen(content);
+    cJSON_free(content);
+    bench_run("lsp_send_response/semanticTokens", message.length, send_response, &message);
+    cJSON_Delete(message.result);
+
+    free(data);
+    tokens_free(&tokens);
+    snapshot_free(snapshot);
+    free(text);
+  }
+  remove(path);
+  fclose(bench_output);
+  return 0;
+}
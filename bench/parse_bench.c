@@ -0,0 +1,79 @@
+// Micro-benchmarks of the lexer and the parser.
+// Sizes are numbers of functions of generated sources, with 8 locals each.
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "minic.h"
+
+typedef struct {
+  const char *text;
+  size_t length;
+  TOKEN_STREAM tokens;
+  ANALYSIS_CACHE *cache;
+} SOURCE;
+
+static void lex(void *argument, long iterations) {
+  SOURCE *source = argument;
+  for(long i = 0; i < iterations; i++) {
+    TOKEN_STREAM stream = { 0 };
+    tokens_sync(&stream, source->text, source->length);
+    bench_sink += stream.tokens_num;
+    tokens_free(&stream);
+  }
+}
+
+// Whole text is lexed and parsed, as `yy_scan_string` and `yyparse` were
+static void parse_text(void *argument, long iterations) {
+  SOURCE *source = argument;
+  for(long i = 0; i < iterations; i++) {
+    cJSON *diagnostics = cJSON_CreateArray();
+    SNAPSHOT *snapshot = parse(diagnostics, source->text, source->length, NULL);
+    bench_sink += snapshot->symbols_num;
+    snapshot_free(snapshot);
+    cJSON_Delete(diagnostics);
+  }
+}
+
+static void parse_lexed(void *argument, long iterations) {
+  SOURCE *source = argument;
+  for(long i = 0; i < iterations; i++) {
+    cJSON *diagnostics = cJSON_CreateArray();
+    SNAPSHOT *snapshot = parse_tokens(diagnostics, source->text, source->tokens.tokens,
+        source->tokens.tokens_num, NULL, NULL);
+    bench_sink += snapshot->symbols_num;
+    snapshot_free(snapshot);
+    cJSON_Delete(diagnostics);
+  }
+}
+
+// Every function is unchanged, so its results are reused
+static void parse_cached(void *argument, long iterations) {
+  SOURCE *source = argument;
+  for(long i = 0; i < iterations; i++) {
+    cJSON *diagnostics = cJSON_CreateArray();
+    SNAPSHOT *snapshot = parse_tokens(diagnostics, source->text, source->tokens.tokens,
+        source->tokens.tokens_num, &source->cache, NULL);
+    bench_sink += snapshot->symbols_num;
+    snapshot_free(snapshot);
+    cJSON_Delete(diagnostics);
+  }
+}
+
+int main(void) {
+  static const int sizes[] = { 10, 100, 1000 };
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    char *text = bench_source(sizes[i], 8, NULL, NULL);
+    SOURCE source = { .text = text, .length = strlen(text) };
+    tokens_sync(&source.tokens, source.text, source.length);
+
+    bench_run("lex", sizes[i], lex, &source);
+    bench_run("parse", sizes[i], parse_text, &source);
+    bench_run("parse_tokens", sizes[i], parse_lexed, &source);
+    bench_run("parse_tokens/cached", sizes[i], parse_cached, &source);
+
+    analysis_free(source.cache);
+    tokens_free(&source.tokens);
+    free(text);
+  }
+  return 0;
+}
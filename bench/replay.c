@@ -0,0 +1,394 @@
+// Replays a LSP session against the language server, and reports
+// throughput and latency percentiles of every request method.
+//
+// The session is either recorded (one client message per line of a file),
+// or scripted: a document is opened, then every round edits it with a burst
+// of changes, and asks for hover, definition and completion.
+// The document is a file, or a generated source with `-f` functions
+// of `-l` local variables each. Edits are typed into the middle function
+// of a generated source, and at the end of a file.
+//
+// Requests are sent one at a time, each after the response of the previous one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <cjson/cJSON.h>
+#include "bench.h"
+
+// Characters typed by each burst of edits, one change per character
+#define TYPED_STATEMENT "  v0 = v0 + p;\n"
+
+typedef struct {
+  const char *method;
+  double *latencies;      // Milliseconds
+  size_t latencies_num;
+  size_t latencies_capacity;
+} METHOD_STATS;
+
+// Options
+int functions_num = 500;
+int locals_num = 8;
+int edits_num = 30;
+int rounds_num = 20;
+const char *source_path;
+const char *session_path;
+
+// Server process
+pid_t server;
+FILE *server_input;
+FILE *server_output;
+
+// Response awaited by the main thread, received by the reader thread
+pthread_mutex_t response_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t response_received = PTHREAD_COND_INITIALIZER;
+int awaited_id = -1;
+int response_done;
+int server_closed;
+
+METHOD_STATS *stats;
+size_t stats_num;
+int next_id = 1;
+int version = 1;
+size_t requests_num;
+size_t notifications_num;
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000.0 + time.tv_nsec / 1e6;
+}
+
+static METHOD_STATS* find_stats(const char *method) {
+  for(size_t i = 0; i < stats_num; i++)
+    if(strcmp(stats[i].method, method) == 0)
+      return &stats[i];
+  stats = realloc(stats, (stats_num + 1) * sizeof(METHOD_STATS));
+  if(stats == NULL) {
+    perror("realloc");
+    exit(EXIT_FAILURE);
+  }
+  METHOD_STATS *method_stats = &stats[stats_num++];
+  memset(method_stats, 0, sizeof(METHOD_STATS));
+  method_stats->method = strdup(method);
+  return method_stats;
+}
+
+static void add_latency(const char *method, double latency) {
+  METHOD_STATS *method_stats = find_stats(method);
+  if(method_stats->latencies_num == method_stats->latencies_capacity) {
+    method_stats->latencies_capacity = method_stats->latencies_capacity
+      ? method_stats->latencies_capacity * 2 : 64;
+    method_stats->latencies = realloc(method_stats->latencies,
+        method_stats->latencies_capacity * sizeof(double));
+    if(method_stats->latencies == NULL) {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  method_stats->latencies[method_stats->latencies_num++] = latency;
+}
+
+// Reads messages of the server, and wakes up the main thread on the awaited response.
+static void* read_responses(void *argument) {
+  (void) argument;
+  char line[256];
+  char *content = NULL;
+  size_t content_capacity = 0;
+  while(1) {
+    unsigned long length = 0;
+    while(fgets(line, sizeof(line), server_output) != NULL) {
+      if(strcmp(line, "\r\n") == 0)
+        break;
+      sscanf(line, "Content-Length: %lu", &length);
+    }
+    if(length == 0)
+      break;
+    if(length + 1 > content_capacity) {
+      content_capacity = length + 1;
+      content = realloc(content, content_capacity);
+      if(content == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+      }
+    }
+    if(fread(content, 1, length, server_output) != length)
+      break;
+
+    cJSON *message = cJSON_ParseWithLength(content, length);
+    const cJSON *id_json = cJSON_GetObjectItem(message, "id");
+    if(cJSON_IsNumber(id_json) && !cJSON_HasObjectItem(message, "method")) {
+      pthread_mutex_lock(&response_lock);
+      if(id_json->valueint == awaited_id) {
+        response_done = 1;
+        pthread_cond_signal(&response_received);
+      }
+      pthread_mutex_unlock(&response_lock);
+    }
+    cJSON_Delete(message);
+  }
+  free(content);
+
+  pthread_mutex_lock(&response_lock);
+  server_closed = 1;
+  pthread_cond_signal(&response_received);
+  pthread_mutex_unlock(&response_lock);
+  return NULL;
+}
+
+static void start_server(char **argv) {
+  int input[2], output[2];
+  if(pipe(input) != 0 || pipe(output) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  server = fork();
+  if(server == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if(server == 0) {
+    dup2(input[0], STDIN_FILENO);
+    dup2(output[1], STDOUT_FILENO);
+    close(input[0]);
+    close(input[1]);
+    close(output[0]);
+    close(output[1]);
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit(EXIT_FAILURE);
+  }
+  close(input[0]);
+  close(output[1]);
+  server_input = fdopen(input[1], "w");
+  server_output = fdopen(output[0], "r");
+}
+
+// Sends a message; requests are timed until their response.
+static void send_message(cJSON *message) {
+  const char *method = cJSON_GetStringValue(cJSON_GetObjectItem(message, "method"));
+  const cJSON *id_json = cJSON_GetObjectItem(message, "id");
+  int request = cJSON_IsNumber(id_json);
+  char *content = cJSON_PrintUnformatted(message);
+
+  pthread_mutex_lock(&response_lock);
+  awaited_id = request ? id_json->valueint : -1;
+  response_done = 0;
+  pthread_mutex_unlock(&response_lock);
+
+  double start = now();
+  fprintf(server_input, "Content-Length: %zu\r\n\r\n%s", strlen(content), content);
+  fflush(server_input);
+  free(content);
+  if(!request) {
+    ++notifications_num;
+    return;
+  }
+
+  pthread_mutex_lock(&response_lock);
+  while(!response_done && !server_closed)
+    pthread_cond_wait(&response_received, &response_lock);
+  int closed = !response_done;
+  pthread_mutex_unlock(&response_lock);
+  if(closed) {
+    fprintf(stderr, "Server closed before responding to %s\n", method);
+    exit(EXIT_FAILURE);
+  }
+  add_latency(method != NULL ? method : "(none)", now() - start);
+  ++requests_num;
+}
+
+static void send_request(const char *method, cJSON *params) {
+  cJSON *message = cJSON_CreateObject();
+  cJSON_AddStringToObject(message, "jsonrpc", "2.0");
+  cJSON_AddNumberToObject(message, "id", next_id++);
+  cJSON_AddStringToObject(message, "method", method);
+  cJSON_AddItemToObject(message, "params", params);
+  send_message(message);
+  cJSON_Delete(message);
+}
+
+static void send_notification(const char *method, cJSON *params) {
+  cJSON *message = cJSON_CreateObject();
+  cJSON_AddStringToObject(message, "jsonrpc", "2.0");
+  cJSON_AddStringToObject(message, "method", method);
+  cJSON_AddItemToObject(message, "params", params);
+  send_message(message);
+  cJSON_Delete(message);
+}
+
+static cJSON* position_json(int line, int character) {
+  cJSON *position = cJSON_CreateObject();
+  cJSON_AddNumberToObject(position, "line", line);
+  cJSON_AddNumberToObject(position, "character", character);
+  return position;
+}
+
+static cJSON* document_params(const char *uri, int line, int character) {
+  cJSON *params = cJSON_CreateObject();
+  cJSON *document = cJSON_AddObjectToObject(params, "textDocument");
+  cJSON_AddStringToObject(document, "uri", uri);
+  cJSON_AddItemToObject(params, "position", position_json(line, character));
+  return params;
+}
+
+static char* read_source(const char *path) {
+  FILE *file = fopen(path, "r");
+  if(file == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  char *text;
+  size_t length;
+  FILE *source = open_memstream(&text, &length);
+  char chunk[4096];
+  size_t read;
+  while((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    fwrite(chunk, 1, read, source);
+  fclose(source);
+  fclose(file);
+  return text;
+}
+
+static void scripted_session(void) {
+  const char *uri = "file:///bench.mc";
+  int call_line = 0, return_line = 0;
+  char *text;
+  if(source_path != NULL) {
+    text = read_source(source_path);
+    for(const char *character = text; *character != '\0'; character++)
+      return_line += *character == '\n';
+  } else {
+    text = bench_source(functions_num, locals_num, &call_line, &return_line);
+  }
+
+  send_request("initialize", cJSON_CreateObject());
+  send_notification("initialized", cJSON_CreateObject());
+  cJSON *params = cJSON_CreateObject();
+  cJSON *document = cJSON_AddObjectToObject(params, "textDocument");
+  cJSON_AddStringToObject(document, "uri", uri);
+  cJSON_AddStringToObject(document, "languageId", "minic");
+  cJSON_AddNumberToObject(document, "version", version);
+  cJSON_AddStringToObject(document, "text", text);
+  send_notification("textDocument/didOpen", params);
+  free(text);
+
+  int typed = 0;
+  for(int round = 0; round < rounds_num; round++) {
+    for(int i = 0; i < edits_num; i++, typed++) {
+      int column = typed % (sizeof(TYPED_STATEMENT) - 1);
+      char change_text[2] = { TYPED_STATEMENT[column], '\0' };
+      params = cJSON_CreateObject();
+      document = cJSON_AddObjectToObject(params, "textDocument");
+      cJSON_AddStringToObject(document, "uri", uri);
+      cJSON_AddNumberToObject(document, "version", ++version);
+      cJSON *change = cJSON_CreateObject();
+      cJSON *range = cJSON_AddObjectToObject(change, "range");
+      cJSON_AddItemToObject(range, "start", position_json(return_line, column));
+      cJSON_AddItemToObject(range, "end", position_json(return_line, column));
+      cJSON_AddStringToObject(change, "text", change_text);
+      cJSON *changes = cJSON_AddArrayToObject(params, "contentChanges");
+      cJSON_AddItemToArray(changes, change);
+      send_notification("textDocument/didChange", params);
+      if(change_text[0] == '\n')
+        ++return_line;
+    }
+    // The call is above the edits, so its position doesn't change
+    send_request("textDocument/hover", document_params(uri, call_line, 7));
+    send_request("textDocument/definition", document_params(uri, call_line, 7));
+    send_request("textDocument/completion", document_params(uri, call_line, 8));
+  }
+}
+
+static void recorded_session(void) {
+  FILE *session = fopen(session_path, "r");
+  if(session == NULL) {
+    perror(session_path);
+    exit(EXIT_FAILURE);
+  }
+  char *line = NULL;
+  size_t capacity = 0;
+  while(getline(&line, &capacity, session) != -1) {
+    cJSON *message = cJSON_Parse(line);
+    if(message == NULL)
+      continue;
+    send_message(message);
+    cJSON_Delete(message);
+  }
+  free(line);
+  fclose(session);
+}
+
+static int compare_latencies(const void *a, const void *b) {
+  double difference = *(const double*) a - *(const double*) b;
+  return (difference > 0) - (difference < 0);
+}
+
+// Nearest-rank percentile of sorted latencies.
+static double percentile(const METHOD_STATS *method_stats, int percent) {
+  size_t rank = (method_stats->latencies_num * percent + 99) / 100;
+  return method_stats->latencies[rank > 0 ? rank - 1 : 0];
+}
+
+static void report(double elapsed) {
+  printf("%-40s %8s %10s %10s %10s\n", "method", "count", "p50 ms", "p95 ms", "p99 ms");
+  for(size_t i = 0; i < stats_num; i++) {
+    METHOD_STATS *method_stats = &stats[i];
+    qsort(method_stats->latencies, method_stats->latencies_num, sizeof(double), compare_latencies);
+    printf("%-40s %8zu %10.3f %10.3f %10.3f\n", method_stats->method, method_stats->latencies_num,
+        percentile(method_stats, 50), percentile(method_stats, 95), percentile(method_stats, 99));
+  }
+  printf("%zu requests and %zu notifications in %.1f ms: %.1f requests/s, %.1f messages/s\n",
+      requests_num, notifications_num, elapsed, requests_num * 1000.0 / elapsed,
+      (requests_num + notifications_num) * 1000.0 / elapsed);
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+      "Usage: %s [-f functions] [-l locals] [-e edits] [-r rounds] [-s source.mc | -p session.jsonl]"
+      " server [arguments]\n", program);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  int option;
+  while((option = getopt(argc, argv, "+f:l:e:r:s:p:")) != -1) {
+    switch(option) {
+      case 'f': functions_num = atoi(optarg); break;
+      case 'l': locals_num = atoi(optarg); break;
+      case 'e': edits_num = atoi(optarg); break;
+      case 'r': rounds_num = atoi(optarg); break;
+      case 's': source_path = optarg; break;
+      case 'p': session_path = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+  if(optind >= argc || functions_num < 1 || locals_num < 1 || edits_num < 0 || rounds_num < 0)
+    usage(argv[0]);
+
+  start_server(argv + optind);
+  pthread_t reader;
+  pthread_create(&reader, NULL, read_responses, NULL);
+
+  double start = now();
+  if(session_path != NULL) {
+    recorded_session();
+  } else {
+    scripted_session();
+    send_request("shutdown", NULL);
+    send_notification("exit", NULL);
+  }
+  double elapsed = now() - start;
+
+  fclose(server_input);
+  pthread_join(reader, NULL);
+  fclose(server_output);
+  int status;
+  waitpid(server, &status, 0);
+
+  report(elapsed);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+// Micro-benchmarks of the symbol table.
+// Sizes are numbers of symbols in the table.
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "arena.h"
+#include "symtab.h"
+
+typedef struct {
+  SYMTAB symtab;
+  char **names;           // Interned names of the symbols
+  char **literals;        // Interned literals, all in the table
+  int *results;
+  int size;
+} TABLE;
+
+static void lookup(void *argument, long iterations) {
+  TABLE *table = argument;
+  for(long i = 0; i < iterations; i++)
+    bench_sink += lookup_symbol(&table->symtab, table->names[i % table->size], VAR|PAR|FUN);
+}
+
+static void lookup_missing(void *argument, long iterations) {
+  TABLE *table = argument;
+  for(long i = 0; i < iterations; i++)
+    bench_sink += lookup_symbol(&table->symtab, table->literals[i % table->size], VAR|PAR|FUN);
+}
+
+static void starts_with(void *argument, long iterations) {
+  TABLE *table = argument;
+  for(long i = 0; i < iterations; i++)
+    bench_sink += lookup_starts_with(&table->symtab, table->results, "s1");
+}
+
+static void literal(void *argument, long iterations) {
+  TABLE *table = argument;
+  for(long i = 0; i < iterations; i++)
+    bench_sink += insert_literal(&table->symtab, table->literals[i % table->size], INT);
+}
+
+// Symbols are inserted up to the size of the table, then cleared
+static void insert(void *argument, long iterations) {
+  TABLE *table = argument;
+  SYMBOL_RANGE no_range = NO_RANGE;
+  int begin = get_last_element(&table->symtab) + 1;
+  for(long i = 0; i < iterations; i++) {
+    if(i % table->size == 0)
+      clear_symbols(&table->symtab, begin);
+    bench_sink += insert_symbol(&table->symtab, table->names[i % table->size], VAR, INT,
+        NO_ATR, NO_ATR, no_range);
+  }
+  clear_symbols(&table->symtab, begin);
+}
+
+int main(void) {
+  static const int sizes[] = { 64, 1024, 16384 };
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    int size = sizes[i];
+    ARENA *arena = arena_create();
+    TABLE table = { .size = size };
+    table.names = malloc(size * sizeof(char*));
+    table.literals = malloc(size * sizeof(char*));
+    table.results = malloc((size * 2 + FUN_REG + 1) * sizeof(int));
+    if(table.names == NULL || table.literals == NULL || table.results == NULL) {
+      perror("malloc");
+      return EXIT_FAILURE;
+    }
+    SYMBOL_RANGE no_range = NO_RANGE;
+    init_symtab(&table.symtab);
+    for(int j = 0; j < size; j++) {
+      char text[16];
+      int length = sprintf(text, "s%d", j);
+      table.names[j] = arena_intern(arena, text, length);
+      length = sprintf(text, "%d", j);
+      table.literals[j] = arena_intern(arena, text, length);
+    }
+
+    bench_run("insert_symbol", size, insert, &table);
+    for(int j = 0; j < size; j++) {
+      insert_symbol(&table.symtab, table.names[j], VAR, INT, NO_ATR, NO_ATR, no_range);
+      insert_literal(&table.symtab, table.literals[j], INT);
+    }
+    bench_run("lookup_symbol", size, lookup, &table);
+    bench_run("lookup_symbol/missing", size, lookup_missing, &table);
+    bench_run("lookup_starts_with", size, starts_with, &table);
+    bench_run("insert_literal", size, literal, &table);
+
+    clear_symtab(&table.symtab);
+    free(table.names);
+    free(table.literals);
+    free(table.results);
+    arena_free(arena);
+  }
+  return 0;
+}
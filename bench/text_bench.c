@@ -0,0 +1,97 @@
+// Micro-benchmarks of buffer text operations.
+// Sizes are lengths of the texts, in bytes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "io.h"
+
+typedef struct {
+  char *text;
+  size_t length;
+  BUFFER *buffer;
+  size_t lines_num;
+} TEXT;
+
+// Cursor at every 61st character of a text of short words
+static void last_symbol(void *argument, long iterations) {
+  TEXT *text = argument;
+  size_t position = 0;
+  for(long i = 0; i < iterations; i++) {
+    position = (position + 61) % text->length;
+    size_t symbol_length;
+    extract_last_symbol(text->text, position, &symbol_length);
+    bench_sink += symbol_length;
+  }
+}
+
+// Cursor at the end of a single word as long as the text
+static void last_long_symbol(void *argument, long iterations) {
+  TEXT *text = argument;
+  for(long i = 0; i < iterations; i++) {
+    size_t symbol_length;
+    extract_last_symbol(text->text, text->length, &symbol_length);
+    bench_sink += symbol_length;
+  }
+}
+
+static void offset(void *argument, long iterations) {
+  TEXT *text = argument;
+  for(long i = 0; i < iterations; i++) {
+    POSITION position = { i * 7919 % text->lines_num, 5 };
+    bench_sink += buffer_offset(text->buffer, position);
+  }
+}
+
+// A character is typed, then the text is joined, as before each analysis
+static void edit(void *argument, long iterations) {
+  TEXT *text = argument;
+  for(long i = 0; i < iterations; i++) {
+    POSITION position = { text->lines_num / 2, i % 16 };
+    edit_buffer(text->buffer, position, position, "x");
+    bench_sink += buffer_content(text->buffer)[0];
+  }
+}
+
+static void edit_only(void *argument, long iterations) {
+  TEXT *text = argument;
+  for(long i = 0; i < iterations; i++) {
+    POSITION position = { text->lines_num / 2, i % 16 };
+    edit_buffer(text->buffer, position, position, "x");
+    bench_sink += text->buffer->length;
+  }
+}
+
+int main(void) {
+  static const size_t sizes[] = { 4096, 65536, 1048576 };
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    TEXT text = { .length = sizes[i] };
+    text.text = malloc(text.length + 1);
+    if(text.text == NULL) {
+      perror("malloc");
+      return EXIT_FAILURE;
+    }
+
+    // Lines of short words, such as a source
+    static const char line[] = "  v12 = v11 + f3(p);\n";
+    for(size_t j = 0; j < text.length; j++) {
+      text.text[j] = line[j % (sizeof(line) - 1)];
+      text.lines_num += text.text[j] == '\n';
+    }
+    text.text[text.length] = '\0';
+    bench_run("extract_last_symbol", text.length, last_symbol, &text);
+
+    char uri[64];
+    sprintf(uri, "file:///bench%zu.mc", i);
+    text.buffer = open_buffer(uri, text.text, 1);
+    bench_run("buffer_offset", text.length, offset, &text);
+    bench_run("edit_buffer", text.length, edit_only, &text);
+    bench_run("edit_buffer/content", text.length, edit, &text);
+    close_buffer(uri);
+
+    memset(text.text, 'a', text.length);
+    bench_run("extract_last_symbol/long", text.length, last_long_symbol, &text);
+    free(text.text);
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "defs.h"
+#include "err_codes.h"
+#include "lsp.h"
+#include "minic.h"
+#include "worker.h"
+#include "check.h"
+
+// Formatted diagnostics of a file, written once all previous files are written
+typedef struct {
+  char *output;
+  int status;
+  int done;
+} CHECK_RESULT;
+
+char **check_paths;
+CHECK_RESULT *check_results;
+int check_files_num;
+enum check_format check_format;
+
+// Guards results and stdout
+pthread_mutex_t check_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t check_finished = PTHREAD_COND_INITIALIZER;
+int check_written;        // Number of files written, in the input order
+int check_any_written;    // Some diagnostic was written (SARIF results need commas)
+int check_status = EXIT_SUCCESS;
+
+static cJSON* sarif_result(const char *path, const cJSON *diagnostic, int severity) {
+  const cJSON *range = cJSON_GetObjectItem(diagnostic, "range");
+  const cJSON *start = cJSON_GetObjectItem(range, "start");
+  const cJSON *end = cJSON_GetObjectItem(range, "end");
+  int start_line = cJSON_GetObjectItem(start, "line")->valueint;
+  int end_line = cJSON_GetObjectItem(end, "line")->valueint;
+
+  cJSON *result = cJSON_CreateObject();
+  cJSON_AddStringToObject(result, "level",
+      severity == ERROR ? "error" : severity == WARNING ? "warning" : "note");
+  cJSON *message = cJSON_AddObjectToObject(result, "message");
+  cJSON_AddStringToObject(message, "text",
+      cJSON_GetStringValue(cJSON_GetObjectItem(diagnostic, "message")));
+  cJSON *location = cJSON_CreateObject();
+  cJSON *physical_location = cJSON_AddObjectToObject(location, "physicalLocation");
+  cJSON *artifact = cJSON_AddObjectToObject(physical_location, "artifactLocation");
+  // Relative paths are made absolute, because file URIs have no base
+  char *absolute = realpath(path, NULL);
+  char *uri = lsp_path_uri(absolute != NULL ? absolute : path);
+  cJSON_AddStringToObject(artifact, "uri", uri);
+  free(uri);
+  free(absolute);
+  // SARIF lines and columns begin at 1
+  cJSON *region = cJSON_AddObjectToObject(physical_location, "region");
+  cJSON_AddNumberToObject(region, "startLine", start_line >= 0 ? start_line + 1 : 1);
+  cJSON_AddNumberToObject(region, "startColumn",
+      cJSON_GetObjectItem(start, "character")->valueint + 1);
+  cJSON_AddNumberToObject(region, "endLine", end_line >= 0 ? end_line + 1 : 1);
+  cJSON_AddNumberToObject(region, "endColumn",
+      cJSON_GetObjectItem(end, "character")->valueint + 1);
+  cJSON_AddItemToArray(cJSON_AddArrayToObject(result, "locations"), location);
+  return result;
+}
+
+// Formats diagnostics of a file, and returns whether there are errors among them.
+static int format_diagnostics(const char *path, cJSON *diagnostics, char **output) {
+  size_t length;
+  FILE *stream = open_memstream(output, &length);
+  if(stream == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  int errors = 0;
+  int first = 1;
+  cJSON *diagnostic;
+  cJSON_ArrayForEach(diagnostic, diagnostics) {
+    int severity = cJSON_GetObjectItem(diagnostic, "severity")->valueint;
+    errors |= severity == ERROR;
+    char *text;
+    if(check_format == CHECK_SARIF) {
+      cJSON *result = sarif_result(path, diagnostic, severity);
+      text = cJSON_PrintUnformatted(result);
+      cJSON_Delete(result);
+      fprintf(stream, first ? "%s" : ",\n%s", text);
+    } else {
+      cJSON_AddStringToObject(diagnostic, "file", path);
+      text = cJSON_PrintUnformatted(diagnostic);
+      fprintf(stream, "%s\n", text);
+    }
+    cJSON_free(text);
+    first = 0;
+  }
+  fclose(stream);
+  return errors;
+}
+
+// Marks a file as checked, and writes results of all files checked so far in the input order.
+static void finish_file(CHECK_RESULT *result) {
+  pthread_mutex_lock(&check_lock);
+  result->done = 1;
+  while(check_written < check_files_num && check_results[check_written].done) {
+    CHECK_RESULT *next = &check_results[check_written++];
+    if(next->output != NULL && next->output[0] != '\0') {
+      if(check_format == CHECK_SARIF && check_any_written)
+        fputs(",\n", stdout);
+      fputs(next->output, stdout);
+      check_any_written = 1;
+    }
+    free(next->output);
+    next->output = NULL;
+    // Unreadable files take precedence over errors
+    if(next->status == EXIT_IO_ERROR || check_status == EXIT_SUCCESS)
+      check_status = next->status;
+  }
+  if(check_written == check_files_num)
+    pthread_cond_signal(&check_finished);
+  pthread_mutex_unlock(&check_lock);
+}
+
+// Lints a file, mapped to memory instead of being read.
+static void check_task(void *argument) {
+  CHECK_RESULT *result = argument;
+  const char *path = check_paths[result - check_results];
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if(fd == -1 || fstat(fd, &st) == -1) {
+    perror(path);
+    if(fd != -1)
+      close(fd);
+    result->status = EXIT_IO_ERROR;
+    finish_file(result);
+    return;
+  }
+  const char *text = "";
+  void *mapping = NULL;
+  if(st.st_size > 0) {
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping == MAP_FAILED) {
+      perror(path);
+      close(fd);
+      result->status = EXIT_IO_ERROR;
+      finish_file(result);
+      return;
+    }
+    text = mapping;
+  }
+  close(fd);
+
+  cJSON *diagnostics = cJSON_CreateArray();
+  SNAPSHOT *snapshot = parse(diagnostics, text, st.st_size, NULL);
+  snapshot_free(snapshot);
+  if(mapping != NULL)
+    munmap(mapping, st.st_size);
+
+  if(format_diagnostics(path, diagnostics, &result->output))
+    result->status = EXIT_CHECK_ERRORS;
+  cJSON_Delete(diagnostics);
+  finish_file(result);
+}
+
+int check_files(char **files, int files_num, int jobs, enum check_format format) {
+  check_paths = files;
+  check_files_num = files_num;
+  check_format = format;
+  check_results = calloc(files_num + 1, sizeof(CHECK_RESULT));
+  if(check_results == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+
+  if(format == CHECK_SARIF)
+    fputs("{\"version\":\"2.1.0\","
+        "\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\","
+        "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"minic-lsp\"}},\"results\":[\n", stdout);
+
+  worker_start(jobs);
+  for(int i = 0; i < files_num; i++)
+    worker_submit(check_task, &check_results[i]);
+
+  pthread_mutex_lock(&check_lock);
+  while(check_written < files_num)
+    pthread_cond_wait(&check_finished, &check_lock);
+  pthread_mutex_unlock(&check_lock);
+
+  if(format == CHECK_SARIF)
+    fputs("\n]}]}\n", stdout);
+  fflush(stdout);
+  free(check_results);
+  return check_status;
+}
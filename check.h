@@ -0,0 +1,20 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Output formats of the batch check
+enum check_format { CHECK_JSONL, CHECK_SARIF };
+
+/*
+ * Lints `files_num` files on `jobs` worker threads
+ * (one per online CPU if `jobs` is not positive), and writes their diagnostics
+ * to stdout in the input order:
+ *   CHECK_JSONL - a line of JSON per diagnostic, LSP diagnostic with its "file"
+ *   CHECK_SARIF - a SARIF 2.1.0 log with a result per diagnostic
+ * Files which can't be read are reported to stderr.
+ *
+ * Returns EXIT_SUCCESS if there are no errors, EXIT_CHECK_ERRORS if a file
+ * has errors, and EXIT_IO_ERROR if a file can't be read.
+ */
+int check_files(char **files, int files_num, int jobs, enum check_format format);
+
+#endif /* end of include guard: CHECK_H */
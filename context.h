@@ -0,0 +1,35 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <stdatomic.h>
+#include <cjson/cJSON.h>
+#include "arena.h"
+#include "symtab.h"
+#include "snapshot.h"
+#include "tokens.h"
+
+/*
+ * State of a single parse.
+ * Every parse has its own context, so parses can run concurrently.
+ */
+typedef struct {
+  SYMTAB symtab;
+  ARENA *arena;           // Owns identifiers and literals (interned)
+  cJSON *diagnostics;     // Diagnostics sink (NULL if not reported)
+  SNAPSHOT *snapshot;     // Symbols recorded as their scopes close
+  int var_num;            // Number of variables in the current function
+  int fun_idx;            // Symbol table index of the current function
+  int fcall_idx;          // Symbol table index of the called function
+  const char *text;       // Parsed text
+  const TOKEN *tokens;    // Tokens of the text, consumed by the parser
+  size_t tokens_num;
+  size_t next_token;
+  const atomic_int *cancelled;  // If set to non-zero, scanning stops (may be NULL)
+} PARSE_CONTEXT;
+
+/*
+ * Adds a diagnostic with `severity` at `range` to the context's diagnostics.
+ */
+void report(PARSE_CONTEXT *ctx, int severity, SYMBOL_RANGE range, const char *format, ...);
+
+#endif /* end of include guard: CONTEXT_H */
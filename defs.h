@@ -8,16 +8,11 @@
 #define LAST_WORKING_REG      12
 #define FUN_REG               13
 #define CHAR_BUFFER_LENGTH   128
-extern char char_buffer[CHAR_BUFFER_LENGTH];
 
-// Output macros
-int yyerror(const char *text);
+// Output macros (for use in parser actions, where `ctx` and `yylloc` exist)
 enum severity { ERROR = 1, WARNING, INFORMATION, HINT };
-extern int severity;
-#define err(...)  sprintf(char_buffer, __VA_ARGS__), \
-                      severity = ERROR, yyerror(char_buffer)
-#define warn(...) sprintf(char_buffer, __VA_ARGS__), \
-                      severity = WARNING, yyerror(char_buffer)
+#define err(...)  report(ctx, ERROR, (SYMBOL_RANGE) RANGE(yylloc), __VA_ARGS__)
+#define warn(...) report(ctx, WARNING, (SYMBOL_RANGE) RANGE(yylloc), __VA_ARGS__)
 
 // Data types
 enum types { NO_TYPE, INT, UINT };
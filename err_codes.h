@@ -6,7 +6,9 @@
 #define EXIT_CONTENT_INCOMPLETE 3
 #define EXIT_IO_ERROR 4
 #define EXIT_PARSE_ERROR 5
-#define EXIT_BUFFERS_FULL 6
 #define EXIT_BUFFER_NOT_OPEN 7
+#define EXIT_THREAD_ERROR 8
+#define EXIT_CHECK_ERRORS 9
+#define EXIT_USAGE 10
 
 #endif /* end of include guard: ERR_CODES_H */
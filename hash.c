@@ -0,0 +1,16 @@
+#include <string.h>
+#include "hash.h"
+
+unsigned long hash_string(const char *string) {
+  return hash_bytes(string, strlen(string));
+}
+
+unsigned long hash_bytes(const char *bytes, size_t length) {
+  // FNV-1a
+  unsigned long hash = 14695981039346656037UL;
+  for(size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char) bytes[i];
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
@@ -0,0 +1,16 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+/*
+ * Returns hash of a string.
+ */
+unsigned long hash_string(const char *string);
+
+/*
+ * Returns hash of the first `length` bytes of `bytes`.
+ */
+unsigned long hash_bytes(const char *bytes, size_t length);
+
+#endif /* end of include guard: HASH_H */
@@ -3,76 +3,413 @@
 #include <string.h>
 #include <ctype.h>
 #include "err_codes.h"
+#include "hash.h"
 #include "io.h"
+#include "snapshot.h"
+#include "analysis.h"
 
-BUFFER buffers[BUFFER_LENGTH];
-unsigned int first_empty_buf;
+// Registry of open buffers: hash table with separate chaining
+#define REGISTRY_INITIAL_SIZE 64
+BUFFER **registry;
+size_t registry_size;
+size_t registry_count;
 
-BUFFER open_buffer(const char *uri, const char *content) {
-  if(first_empty_buf >= BUFFER_LENGTH)
-    exit(EXIT_BUFFERS_FULL);
-  buffers[first_empty_buf].uri = strdup(uri);
-  buffers[first_empty_buf].content = strdup(content);
-  return buffers[first_empty_buf++];
+static void* grow(void *array, size_t *capacity, size_t needed, size_t element_size) {
+  if(needed <= *capacity)
+    return array;
+  size_t new_capacity = *capacity ? *capacity : 16;
+  while(new_capacity < needed)
+    new_capacity *= 2;
+  array = realloc(array, new_capacity * element_size);
+  if(array == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  *capacity = new_capacity;
+  return array;
 }
 
-BUFFER update_buffer(const char *uri, const char *content) {
-  for(unsigned int i = 0; i < first_empty_buf; i++) {
-    if(strcmp(buffers[i].uri, uri) == 0) {
-      free(buffers[i].content);
-      buffers[i].content = strdup(content);
-      return buffers[i];
-    }
+static void reset_buffer(BUFFER *buffer, const char *content, int version) {
+  free(buffer->original);
+  buffer->original = strdup(content);
+  if(buffer->original == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  buffer->original_length = strlen(content);
+  buffer->add_length = 0;
+  buffer->pieces_num = 0;
+  if(buffer->original_length > 0) {
+    buffer->pieces = grow(buffer->pieces, &buffer->pieces_capacity, 1, sizeof(PIECE));
+    buffer->pieces[0] = (PIECE) { PIECE_ORIGINAL, 0, buffer->original_length };
+    buffer->pieces_num = 1;
+  }
+  buffer->length = buffer->original_length;
+  buffer->version = version;
+  snapshot_free(buffer->snapshot);
+  buffer->snapshot = NULL;
+  tokens_invalidate(&buffer->tokens);
+  buffer->diagnostics_published = 0;
+
+  buffer->lines_num = 0;
+  buffer->line_starts = grow(buffer->line_starts, &buffer->lines_capacity, 1, sizeof(size_t));
+  buffer->line_starts[buffer->lines_num++] = 0;
+  for(const char *newline = buffer->original;
+      (newline = strchr(newline, '\n')) != NULL; newline++) {
+    buffer->line_starts = grow(buffer->line_starts, &buffer->lines_capacity,
+        buffer->lines_num + 1, sizeof(size_t));
+    buffer->line_starts[buffer->lines_num++] = newline + 1 - buffer->original;
+  }
+}
+
+// Returns index of the first line which begins after `offset`.
+static size_t line_after(const BUFFER *buffer, size_t offset) {
+  size_t low = 0, high = buffer->lines_num;
+  while(low < high) {
+    size_t middle = low + (high - low) / 2;
+    if(buffer->line_starts[middle] <= offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+// Updates line starts after an edit, which inserted `text` with `inserted_num` newlines.
+static void update_lines(BUFFER *buffer, size_t start_offset, size_t end_offset,
+    const char *text, size_t text_length, size_t inserted_num) {
+  // Lines beginning inside of the replaced text are removed
+  size_t first = line_after(buffer, start_offset);
+  size_t last = line_after(buffer, end_offset);
+
+  size_t lines_num = buffer->lines_num - (last - first) + inserted_num;
+  buffer->line_starts = grow(buffer->line_starts, &buffer->lines_capacity,
+      lines_num, sizeof(size_t));
+  memmove(buffer->line_starts + first + inserted_num, buffer->line_starts + last,
+      (buffer->lines_num - last) * sizeof(size_t));
+  size_t i = first;
+  for(const char *newline = text; (newline = strchr(newline, '\n')) != NULL; newline++) {
+    buffer->line_starts[i++] = start_offset + (newline + 1 - text);
+  }
+  for(; i < lines_num; i++) {
+    buffer->line_starts[i] = buffer->line_starts[i] + text_length - (end_offset - start_offset);
   }
-  exit(EXIT_BUFFER_NOT_OPEN);
+  buffer->lines_num = lines_num;
 }
 
-BUFFER get_buffer(const char *uri) {
-  for(unsigned int i = 0; i < first_empty_buf; i++) {
-    if(strcmp(buffers[i].uri, uri) == 0) {
-      return buffers[i];
+static const char* piece_text(const BUFFER *buffer, const PIECE *piece) {
+  if(piece->source == PIECE_ORIGINAL)
+    return buffer->original + piece->start;
+  return buffer->add + piece->start;
+}
+
+static BUFFER** find_slot(const char *uri, unsigned long hash) {
+  if(registry == NULL)
+    return NULL;
+  BUFFER **slot = &registry[hash & (registry_size - 1)];
+  while(*slot != NULL && ((*slot)->hash != hash || strcmp((*slot)->uri, uri) != 0)) {
+    slot = &(*slot)->next;
+  }
+  return slot;
+}
+
+static void grow_registry(void) {
+  size_t size = registry_size ? registry_size * 2 : REGISTRY_INITIAL_SIZE;
+  BUFFER **table = calloc(size, sizeof(BUFFER*));
+  if(table == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  for(size_t i = 0; i < registry_size; i++) {
+    BUFFER *buffer = registry[i];
+    while(buffer != NULL) {
+      BUFFER *next = buffer->next;
+      BUFFER **bucket = &table[buffer->hash & (size - 1)];
+      buffer->next = *bucket;
+      *bucket = buffer;
+      buffer = next;
     }
   }
-  exit(EXIT_BUFFER_NOT_OPEN);
+  free(registry);
+  registry = table;
+  registry_size = size;
 }
 
-void close_buffer(const char *uri) {
-  for(unsigned int i = 0; i < first_empty_buf; i++) {
-    if(strcmp(buffers[i].uri, uri) == 0) {
-      free(buffers[i].uri);
-      free(buffers[i].content);
-      for(unsigned int j = i; j < first_empty_buf - 1; j++) {
-        buffers[j] = buffers[j + 1];
-      }
-      --first_empty_buf;
+BUFFER* open_buffer(const char *uri, const char *content, int version) {
+  unsigned long hash = hash_string(uri);
+  BUFFER **slot = find_slot(uri, hash);
+  if(slot != NULL && *slot != NULL) { // Reopened without closing
+    lock_buffer(*slot);
+    reset_buffer(*slot, content, version);
+    unlock_buffer(*slot);
+    return *slot;
+  }
+
+  if(registry_count + 1 > registry_size / 4 * 3)
+    grow_registry();
+  BUFFER *buffer = calloc(1, sizeof(BUFFER));
+  if(buffer == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  buffer->uri = strdup(uri);
+  buffer->hash = hash;
+  buffer->references = 1;
+  pthread_mutexattr_t lock_attributes;
+  pthread_mutexattr_init(&lock_attributes);
+  pthread_mutexattr_settype(&lock_attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&buffer->lock, &lock_attributes);
+  pthread_mutexattr_destroy(&lock_attributes);
+  reset_buffer(buffer, content, version);
+
+  BUFFER **bucket = &registry[hash & (registry_size - 1)];
+  buffer->next = *bucket;
+  *bucket = buffer;
+  ++registry_count;
+  return buffer;
+}
+
+BUFFER* update_buffer(const char *uri, const char *content, int version) {
+  BUFFER *buffer = get_buffer(uri);
+  lock_buffer(buffer);
+  reset_buffer(buffer, content, version);
+  unlock_buffer(buffer);
+  return buffer;
+}
+
+// Moves published diagnostics below an edit of lines [first, last] which
+// inserted `inserted_num` newlines. Diagnostics on those lines may have moved
+// in any way, so they are published again.
+static void shift_diagnostics(BUFFER *buffer, int first, int last, int inserted_num) {
+  for(size_t i = 0; i < buffer->diagnostics_num; i++) {
+    DIAGNOSTIC_MARK *mark = &buffer->diagnostics[i];
+    if(mark->last_line < first)
+      continue;
+    if(mark->first_line <= last) {
+      buffer->diagnostics_published = 0;
       return;
     }
+    mark->first_line += inserted_num - (last - first);
+    mark->last_line += inserted_num - (last - first);
   }
-  exit(EXIT_BUFFER_NOT_OPEN);
 }
 
-void truncate_string(char *text, int line, int character) {
-  unsigned int position = 0;
-  for(int i = 0; i < line; i++) {
-    position += strcspn(text + position, "\n") + 1;
+void edit_buffer(BUFFER *buffer, POSITION start, POSITION end, const char *text) {
+  lock_buffer(buffer);
+  size_t start_offset = buffer_offset(buffer, start);
+  size_t end_offset = buffer_offset(buffer, end);
+  if(end_offset < start_offset)
+    end_offset = start_offset;
+  size_t text_length = strlen(text);
+  size_t inserted_num = 0;
+  for(const char *newline = text; (newline = strchr(newline, '\n')) != NULL; newline++) {
+    ++inserted_num;
+  }
+  if(buffer->diagnostics_published) {
+    shift_diagnostics(buffer, line_after(buffer, start_offset) - 1,
+        line_after(buffer, end_offset) - 1, inserted_num);
   }
-  position += character;
+  update_lines(buffer, start_offset, end_offset, text, text_length, inserted_num);
+  tokens_damage(&buffer->tokens, start_offset, end_offset, start_offset + text_length);
 
-  if(position >= strlen(text)) {
-    return;
+  // Pieces [first, last) are affected by the edit
+  size_t first = 0, first_begin = 0;
+  while(first < buffer->pieces_num
+        && first_begin + buffer->pieces[first].length <= start_offset) {
+    first_begin += buffer->pieces[first].length;
+    ++first;
+  }
+  size_t last = first, last_begin = first_begin;
+  while(last < buffer->pieces_num
+        && last_begin + buffer->pieces[last].length <= end_offset) {
+    last_begin += buffer->pieces[last].length;
+    ++last;
   }
 
-  while(isalnum(*(text + position))) {
-    ++position;
+  PIECE replacement[3];
+  size_t replacement_num = 0;
+  if(first < buffer->pieces_num && start_offset > first_begin) {
+    replacement[replacement_num] = buffer->pieces[first];
+    replacement[replacement_num++].length = start_offset - first_begin;
   }
-  text[position] = '\0';
+  if(text_length > 0) {
+    // Consecutive insertions extend the previous piece instead of adding a new one
+    PIECE *previous = NULL;
+    if(replacement_num > 0)
+      previous = &replacement[0];
+    else if(first > 0)
+      previous = &buffer->pieces[first - 1];
+    buffer->add = grow(buffer->add, &buffer->add_capacity,
+        buffer->add_length + text_length, 1);
+    memcpy(buffer->add + buffer->add_length, text, text_length);
+    if(previous != NULL && previous->source == PIECE_ADD
+       && previous->start + previous->length == buffer->add_length) {
+      previous->length += text_length;
+    }
+    else {
+      replacement[replacement_num++] =
+        (PIECE) { PIECE_ADD, buffer->add_length, text_length };
+    }
+    buffer->add_length += text_length;
+  }
+  if(last < buffer->pieces_num) {
+    size_t skip = end_offset - last_begin;
+    replacement[replacement_num] = buffer->pieces[last];
+    replacement[replacement_num].start += skip;
+    replacement[replacement_num++].length -= skip;
+    ++last;
+  }
+
+  size_t removed_num = last - first;
+  size_t pieces_num = buffer->pieces_num - removed_num + replacement_num;
+  buffer->pieces = grow(buffer->pieces, &buffer->pieces_capacity, pieces_num, sizeof(PIECE));
+  memmove(buffer->pieces + first + replacement_num, buffer->pieces + last,
+      (buffer->pieces_num - last) * sizeof(PIECE));
+  memcpy(buffer->pieces + first, replacement, replacement_num * sizeof(PIECE));
+  buffer->pieces_num = pieces_num;
+  buffer->length += text_length;
+  buffer->length -= end_offset - start_offset;
+  unlock_buffer(buffer);
 }
 
-const char* extract_last_symbol(char *text) {
-  for(unsigned int position = strlen(text) - 1; position > 0; position--) {
-    if(!isalnum(text[position - 1])) {
-      return text + position;
-    }
+const char* buffer_content(BUFFER *buffer) {
+  if(buffer->length == buffer->original_length
+     && (buffer->pieces_num == 0
+       || (buffer->pieces_num == 1 && buffer->pieces[0].source == PIECE_ORIGINAL))) {
+    return buffer->original;
   }
+  lock_buffer(buffer);
+
+  // Join pieces and make the result the new original text
+  char *content = malloc(buffer->length + 1);
+  if(content == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  size_t position = 0;
+  for(size_t i = 0; i < buffer->pieces_num; i++) {
+    memcpy(content + position, piece_text(buffer, &buffer->pieces[i]),
+        buffer->pieces[i].length);
+    position += buffer->pieces[i].length;
+  }
+  content[position] = '\0';
+
+  free(buffer->original);
+  buffer->original = content;
+  buffer->original_length = buffer->length;
+  buffer->add_length = 0;
+  buffer->pieces_num = 0;
+  if(buffer->length > 0) {
+    buffer->pieces[0] = (PIECE) { PIECE_ORIGINAL, 0, buffer->length };
+    buffer->pieces_num = 1;
+  }
+  unlock_buffer(buffer);
+  return buffer->original;
+}
+
+char* buffer_copy(BUFFER *buffer, size_t *length) {
+  lock_buffer(buffer);
+  char *text = malloc(buffer->length + 1);
+  if(text == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  size_t position = 0;
+  for(size_t i = 0; i < buffer->pieces_num; i++) {
+    memcpy(text + position, piece_text(buffer, &buffer->pieces[i]),
+        buffer->pieces[i].length);
+    position += buffer->pieces[i].length;
+  }
+  text[position] = '\0';
+  *length = position;
+  unlock_buffer(buffer);
   return text;
 }
+
+void lock_buffer(BUFFER *buffer) {
+  pthread_mutex_lock(&buffer->lock);
+}
+
+void unlock_buffer(BUFFER *buffer) {
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+BUFFER* retain_buffer(BUFFER *buffer) {
+  lock_buffer(buffer);
+  ++buffer->references;
+  unlock_buffer(buffer);
+  return buffer;
+}
+
+void release_buffer(BUFFER *buffer) {
+  lock_buffer(buffer);
+  int references = --buffer->references;
+  unlock_buffer(buffer);
+  if(references > 0)
+    return;
+
+  free(buffer->uri);
+  free(buffer->original);
+  free(buffer->add);
+  free(buffer->pieces);
+  free(buffer->line_starts);
+  snapshot_free(buffer->snapshot);
+  tokens_free(&buffer->tokens);
+  analysis_free(buffer->analysis);
+  free(buffer->semantic_tokens);
+  free(buffer->diagnostics);
+  pthread_mutex_destroy(&buffer->lock);
+  free(buffer);
+}
+
+size_t buffer_offset(const BUFFER *buffer, POSITION position) {
+  if(position.line < 0)
+    return 0;
+  if((size_t) position.line >= buffer->lines_num)
+    return buffer->length;
+
+  size_t offset = buffer->line_starts[position.line];
+  size_t line_end = buffer->length;
+  if((size_t) position.line + 1 < buffer->lines_num)
+    line_end = buffer->line_starts[position.line + 1] - 1;
+  if(position.character < 0)
+    return offset;
+  if((size_t) position.character < line_end - offset)
+    return offset + position.character;
+  return line_end;
+}
+
+POSITION buffer_position(const BUFFER *buffer, size_t offset) {
+  if(offset > buffer->length)
+    offset = buffer->length;
+  size_t line = line_after(buffer, offset) - 1;
+  POSITION position = { line, offset - buffer->line_starts[line] };
+  return position;
+}
+
+size_t buffer_prefix(BUFFER *buffer, POSITION position) {
+  const char *text = buffer_content(buffer);
+  size_t offset = buffer_offset(buffer, position);
+  while(offset < buffer->length && isalnum(text[offset])) {
+    ++offset;
+  }
+  return offset;
+}
+
+BUFFER* get_buffer(const char *uri) {
+  BUFFER **slot = find_slot(uri, hash_string(uri));
+  if(slot == NULL || *slot == NULL)
+    exit(EXIT_BUFFER_NOT_OPEN);
+  return *slot;
+}
+
+void close_buffer(const char *uri) {
+  BUFFER **slot = find_slot(uri, hash_string(uri));
+  if(slot == NULL || *slot == NULL)
+    exit(EXIT_BUFFER_NOT_OPEN);
+
+  BUFFER *buffer = *slot;
+  *slot = buffer->next;
+  --registry_count;
+  lock_buffer(buffer);
+  buffer->closed = 1;
+  unlock_buffer(buffer);
+  release_buffer(buffer);
+}
+
+const char* extract_last_symbol(const char *text, size_t length, size_t *symbol_length) {
+  size_t position = length;
+  while(position > 0 && isalnum(text[position - 1])) {
+    --position;
+  }
+  *symbol_length = length - position;
+  return text + position;
+}
@@ -1,40 +1,161 @@
 #ifndef IO_H
 #define IO_H
 
-#define BUFFER_LENGTH 100
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "tokens.h"
+
+typedef struct {
+	int line;
+	int character;
+} POSITION;
+
+// Backing store a piece of text points into.
+enum piece_source { PIECE_ORIGINAL, PIECE_ADD };
+
+typedef struct {
+	enum piece_source source;
+	size_t start;
+	size_t length;
+} PIECE;
+
+// Diagnostic published to the client. Lines are kept apart from the rest,
+// which is hashed, so diagnostics moved by an edit are compared cheaply.
 typedef struct {
+	int first_line;
+	int last_line;
+	unsigned long hash;         // Hash of message, severity and characters
+} DIAGNOSTIC_MARK;
+
+// State of the background analysis of a buffer.
+enum lint_state { LINT_IDLE, LINT_QUEUED, LINT_RUNNING };
+
+typedef struct buffer {
 	char *uri;
-	char *content;
+	unsigned long hash;         // Hash of `uri`
+	struct buffer *next;        // Next buffer in the same registry bucket
+	int version;
+	// Piece table: text is the concatenation of `pieces`, each referring
+	// to a span of the read-only `original` or the append-only `add` text.
+	char *original;
+	size_t original_length;
+	char *add;
+	size_t add_length;
+	size_t add_capacity;
+	PIECE *pieces;
+	size_t pieces_num;
+	size_t pieces_capacity;
+	size_t length;
+	// Offsets at which lines begin (the first line begins at 0)
+	size_t *line_starts;
+	size_t lines_num;
+	size_t lines_capacity;
+	// Result of the last analysis (possibly of an older version)
+	struct snapshot *snapshot;
+	// Tokens of the text, lexed again around edits when they are needed
+	TOKEN_STREAM tokens;
+	// Results of the last analysis of each function, reused by the next one
+	struct analysis_cache *analysis;
+	// Semantic tokens last sent to the client, which delta requests are based on
+	int *semantic_tokens;
+	size_t semantic_tokens_num;
+	int semantic_result;        // Result id of `semantic_tokens`
+	// Diagnostics last published, moved by later edits as clients move them
+	DIAGNOSTIC_MARK *diagnostics;
+	size_t diagnostics_num;
+	int diagnostics_published;  // Unset when an edit touched some of `diagnostics`
+	// Fields below and everything changed by edits are guarded by `lock`,
+	// because worker threads read buffers while they are being edited.
+	pthread_mutex_t lock;
+	int references;
+	int closed;
+	enum lint_state lint_state;
+	int lint_pending;           // Buffer changed while the analysis was running
+	long long lint_due;         // Monotonic time the analysis may start at
+	atomic_int lint_cancelled;  // Set to stop the running analysis
 } BUFFER;
 
 /*
  * Opens a new buffer.
  */
-BUFFER open_buffer(const char *uri, const char *content);
+BUFFER* open_buffer(const char *uri, const char *content, int version);
 
 /*
- * Updates content of an existing buffer.
+ * Replaces the whole content of an existing buffer.
  */
-BUFFER update_buffer(const char *uri, const char *content);
+BUFFER* update_buffer(const char *uri, const char *content, int version);
 
 /*
- * Searches a buffer by `uri` and returns its handle.
+ * Replaces text between `start` and `end` positions with `text`.
+ * Positions outside of the buffer are clamped to its bounds.
  */
-BUFFER get_buffer(const char *uri);
+void edit_buffer(BUFFER *buffer, POSITION start, POSITION end, const char *text);
 
 /*
- * Closes a buffer.
+ * Returns the content of a buffer as a contiguous string.
+ *
+ * Pieces are joined only when the buffer was edited since the last call.
+ * The result is valid until the next edit.
+ * Only the thread which edits the buffer may call this function.
  */
-void close_buffer(const char *uri);
+const char* buffer_content(BUFFER *buffer);
+
+/*
+ * Returns a copy of the buffer text, and stores its length to `length`.
+ *
+ * WARNING: Caller is responsible to free the result.
+ */
+char* buffer_copy(BUFFER *buffer, size_t *length);
+
+/*
+ * Locks a buffer for exclusive access.
+ * A thread may lock the same buffer more than once.
+ */
+void lock_buffer(BUFFER *buffer);
+void unlock_buffer(BUFFER *buffer);
+
+/*
+ * Takes a reference to a buffer, which keeps it alive after it is closed.
+ */
+BUFFER* retain_buffer(BUFFER *buffer);
+
+/*
+ * Drops a reference to a buffer, and frees it if it was the last one.
+ */
+void release_buffer(BUFFER *buffer);
+
+/*
+ * Converts a line/character position to an offset in the buffer text.
+ * Character is clamped to the end of the line.
+ */
+size_t buffer_offset(const BUFFER *buffer, POSITION position);
+
+/*
+ * Converts an offset in the buffer text to a line/character position.
+ */
+POSITION buffer_position(const BUFFER *buffer, size_t offset);
 
 /*
- * Truncates a given string to the specified length.
+ * Returns length of the buffer text up to the end of the word at `position`.
  */
-void truncate_string(char *text, int line, int character);
+size_t buffer_prefix(BUFFER *buffer, POSITION position);
+
+/*
+ * Searches a buffer by `uri` and returns its handle.
+ */
+BUFFER* get_buffer(const char *uri);
+
+/*
+ * Closes a buffer.
+ * The buffer is freed once all references to it are released.
+ */
+void close_buffer(const char *uri);
 
 /*
- * Returns the last symbol in a string.
+ * Returns the last symbol in the first `length` characters of `text`,
+ * and stores its length to `symbol_length`.
  */
-const char* extract_last_symbol(char *text);
+const char* extract_last_symbol(const char *text, size_t length, size_t *symbol_length);
 
 #endif /* end of include guard: IO_H */
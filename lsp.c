@@ -1,56 +1,278 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include "minic.h"
 #include "err_codes.h"
+#include "hash.h"
+#include "worker.h"
+#include "workspace.h"
+#include "stats.h"
 #include "lsp.h"
-#define MAX_HEADER_FIELD_LEN 100
+#define MAX_HEADER_FIELD_LEN 1024
+#define MAX_CONTENT_LENGTH (1UL << 30)
+#define CANCELLED_LENGTH 64
+#define MESSAGES_LENGTH 64
+#define RPC_SLOTS_LENGTH 128
+// cJSON_PrintPreallocated needs a few spare bytes
+#define MIN_OUTPUT_CAPACITY 4096
+
+// Serializes messages written by the main and the worker threads.
+// Messages are queued to `pending_output`, and written in batches
+// by one thread at a time, while `flushed_output` keeps its memory.
+pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+char *serialize_buffer;
+int serialize_capacity;
+OUTPUT_BUFFER pending_output;
+OUTPUT_BUFFER flushed_output;
+int output_flushing;
+
+// Messages read by the reader thread, waiting to be handled.
+// NULL message marks the end of input.
+pthread_mutex_t message_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t message_available = PTHREAD_COND_INITIALIZER;
+pthread_cond_t message_space = PTHREAD_COND_INITIALIZER;
+cJSON *messages[MESSAGES_LENGTH];
+const RPC_METHOD *message_methods[MESSAGES_LENGTH];
+size_t messages_head;
+size_t messages_num;
+
+// Receive buffer of the reader thread, reused for every message
+char *receive_buffer;
+size_t receive_capacity;
+
+// Methods the server handles, and their perfect hash table.
+// Slots hold method index + 1, or 0 if empty.
+// Queries at the cursor have the highest priority, and workspace queries the lowest.
+const RPC_METHOD rpc_methods[] = {
+  // method                                    request                     notification         priority  writes  immediate
+  { "initialize",                              lsp_initialize,             NULL,                0,        1,      0 },
+  { "shutdown",                                lsp_shutdown,               NULL,                0,        1,      0 },
+  { "exit",                                    NULL,                       lsp_exit,            0,        1,      0 },
+  { "textDocument/didOpen",                    NULL,                       lsp_sync_open,       0,        1,      0 },
+  { "textDocument/didChange",                  NULL,                       lsp_sync_change,     0,        1,      0 },
+  { "textDocument/didClose",                   NULL,                       lsp_sync_close,      0,        1,      0 },
+  { "textDocument/didSave",                    NULL,                       lsp_sync_save,       0,        1,      0 },
+  { "workspace/didChangeWatchedFiles",         NULL,                       lsp_watched_files,   0,        1,      0 },
+  { "textDocument/hover",                      lsp_hover,                  NULL,                2,        0,      0 },
+  { "textDocument/definition",                 lsp_goto_definition,        NULL,                2,        0,      0 },
+  { "textDocument/completion",                 lsp_completion,             NULL,                2,        0,      0 },
+  { "completionItem/resolve",                  lsp_completion_resolve,     NULL,                2,        0,      0 },
+  { "textDocument/references",                 lsp_references,             NULL,                1,        0,      0 },
+  { "textDocument/documentHighlight",          lsp_document_highlight,     NULL,                2,        0,      0 },
+  { "textDocument/rename",                     lsp_rename,                 NULL,                1,        0,      0 },
+  { "textDocument/semanticTokens/full",        lsp_semantic_tokens_full,   NULL,                1,        0,      0 },
+  { "textDocument/semanticTokens/full/delta",  lsp_semantic_tokens_delta,  NULL,                1,        0,      0 },
+  { "textDocument/semanticTokens/range",       lsp_semantic_tokens_range,  NULL,                1,        0,      0 },
+  { "$/minic/stats",                           lsp_stats,                  NULL,                0,        0,      0 },
+  { "workspace/symbol",                        lsp_workspace_symbol,       NULL,                0,        0,      0 },
+  { "$/cancelRequest",                         NULL,                       lsp_cancel_request,  0,        0,      1 },
+};
+#define RPC_METHODS_NUM (sizeof(rpc_methods) / sizeof(rpc_methods[0]))
+int rpc_slots[RPC_SLOTS_LENGTH];
+unsigned int rpc_seed;
+
+// Request being handled, and whether it was cancelled in the meantime
+atomic_int current_request = -1;
+atomic_int request_cancelled;
+
+// Statistics slot of the method handled by the thread, which messages it writes are counted to
+_Thread_local int output_method = STATS_OTHER_METHOD;
+
+// Milliseconds without changes a document waits before it is linted
+long diagnostics_delay = DEFAULT_DIAGNOSTICS_DELAY;
+
+// Ring of recently cancelled request ids
+pthread_mutex_t cancel_lock = PTHREAD_MUTEX_INITIALIZER;
+int cancelled_ids[CANCELLED_LENGTH];
+unsigned int cancelled_num;
 
 void lsp_event_loop(void) {
+  lsp_dispatch_init();
+  worker_start(0);
+
+  pthread_t reader;
+  if(pthread_create(&reader, NULL, lsp_reader, NULL) != 0)
+    exit(EXIT_THREAD_ERROR);
+  pthread_detach(reader);
+
   for(;;) {
-    unsigned long content_length = lsp_parse_header();
-    cJSON *request = lsp_parse_content(content_length);
+    cJSON *request = lsp_queue_pop();
+    if(request == NULL) // Input closed without exit notification
+      exit(EXIT_IO_ERROR);
     json_rpc(request);
     cJSON_Delete(request);
   }
 }
 
+void* lsp_reader(void *argument) {
+  (void) argument;
+  for(;;) {
+    unsigned long content_length = lsp_parse_header();
+    if(content_length == 0) {
+      lsp_queue_push(NULL, NULL);
+      return NULL;
+    }
+    cJSON *message = lsp_parse_content(content_length);
+
+    // Some notifications must not wait behind the requests they affect
+    const cJSON *method_json = cJSON_GetObjectItem(message, "method");
+    const RPC_METHOD *method = cJSON_IsString(method_json) ? lsp_find_method(method_json->valuestring) : NULL;
+    stats_bytes_in(lsp_stats_slot(method), content_length);
+    if(method != NULL && method->immediate && method->notification != NULL) {
+      long long start = stats_now();
+      method->notification(cJSON_GetObjectItem(message, "params"));
+      stats_method(lsp_stats_slot(method), method->method, -1, start);
+      cJSON_Delete(message);
+      continue;
+    }
+    lsp_queue_push(message, method);
+  }
+}
+
+void lsp_queue_push(cJSON *message, const RPC_METHOD *method) {
+  pthread_mutex_lock(&message_lock);
+  while(messages_num == MESSAGES_LENGTH)
+    pthread_cond_wait(&message_space, &message_lock);
+  size_t slot = (messages_head + messages_num) % MESSAGES_LENGTH;
+  messages[slot] = message;
+  message_methods[slot] = method;
+  ++messages_num;
+  pthread_cond_signal(&message_available);
+  pthread_mutex_unlock(&message_lock);
+}
+
+// Returns whether a queued message must be handled after everything before it.
+static int is_ordered(const cJSON *message, const RPC_METHOD *method) {
+  // Unknown messages and the end of input keep their place too
+  return message == NULL || method == NULL || method->writes_buffers;
+}
+
+cJSON* lsp_queue_pop(void) {
+  pthread_mutex_lock(&message_lock);
+  while(messages_num == 0)
+    pthread_cond_wait(&message_available, &message_lock);
+  // Requests before the first write see the same buffers in any order
+  size_t chosen = 0;
+  for(size_t i = 0; i < messages_num; i++) {
+    size_t slot = (messages_head + i) % MESSAGES_LENGTH;
+    if(is_ordered(messages[slot], message_methods[slot]))
+      break;
+    const RPC_METHOD *best = message_methods[(messages_head + chosen) % MESSAGES_LENGTH];
+    if(message_methods[slot]->priority > best->priority)
+      chosen = i;
+  }
+  cJSON *message = messages[(messages_head + chosen) % MESSAGES_LENGTH];
+  // Messages before the chosen one move up by a slot
+  for(size_t i = chosen; i > 0; i--) {
+    size_t slot = (messages_head + i) % MESSAGES_LENGTH;
+    size_t previous = (messages_head + i - 1) % MESSAGES_LENGTH;
+    messages[slot] = messages[previous];
+    message_methods[slot] = message_methods[previous];
+  }
+  messages_head = (messages_head + 1) % MESSAGES_LENGTH;
+  --messages_num;
+  pthread_cond_signal(&message_space);
+  pthread_mutex_unlock(&message_lock);
+  return message;
+}
+
+void lsp_reserve_receive_buffer(size_t capacity) {
+  if(capacity <= receive_capacity)
+    return;
+  size_t new_capacity = receive_capacity ? receive_capacity : MAX_HEADER_FIELD_LEN;
+  while(new_capacity < capacity) {
+    if(new_capacity > SIZE_MAX / 2) { // Doubling would overflow
+      new_capacity = capacity;
+      break;
+    }
+    new_capacity *= 2;
+  }
+  char *new_buffer = realloc(receive_buffer, new_capacity);
+  if(new_buffer == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  receive_buffer = new_buffer;
+  receive_capacity = new_capacity;
+}
+
 unsigned long lsp_parse_header(void) {
-  char buffer[MAX_HEADER_FIELD_LEN];
   unsigned long content_length = 0;
+  size_t field_length = 0;
 
+  lsp_reserve_receive_buffer(MAX_HEADER_FIELD_LEN);
   for(;;) {
-    fgets(buffer, MAX_HEADER_FIELD_LEN, stdin);
-    if(strcmp(buffer, "\r\n") == 0) { // End of header
+    // Only the reader thread reads stdin
+    int c = getc_unlocked(stdin);
+    if(c == EOF) // End of input
+      return 0;
+    if(c != '\n') {
+      if(field_length == MAX_HEADER_FIELD_LEN)
+        exit(EXIT_HEADER_INCOMPLETE);
+      receive_buffer[field_length++] = c;
+      continue;
+    }
+
+    if(field_length > 0 && receive_buffer[field_length - 1] == '\r')
+      --field_length;
+    if(field_length == 0) { // End of header
       if(content_length == 0)
         exit(EXIT_HEADER_INCOMPLETE);
       return content_length;
     }
+    lsp_parse_header_field(receive_buffer, field_length, &content_length);
+    field_length = 0;
+  }
+}
 
-    char *buffer_part = strtok(buffer, " ");
-    if(strcmp(buffer_part, "Content-Length:") == 0) {
-      buffer_part = strtok(NULL, "\n");
-      content_length = atoi(buffer_part);
-    }
+void lsp_parse_header_field(const char *field, size_t length, unsigned long *content_length) {
+  const char *colon = memchr(field, ':', length);
+  if(colon == NULL)
+    exit(EXIT_HEADER_INCOMPLETE);
+
+  // Field names are case-insensitive, other fields (Content-Type) are ignored
+  size_t name_length = colon - field;
+  if(name_length != strlen("Content-Length") || strncasecmp(field, "Content-Length", name_length) != 0)
+    return;
+
+  unsigned long value = 0;
+  const char *c = colon + 1;
+  const char *end = field + length;
+  while(c < end && (*c == ' ' || *c == '\t'))
+    ++c;
+  if(c == end)
+    exit(EXIT_HEADER_INCOMPLETE);
+  for(; c < end && *c != ' ' && *c != '\t'; ++c) {
+    if(*c < '0' || *c > '9')
+      exit(EXIT_HEADER_INCOMPLETE);
+    // Larger messages are rejected before the value can overflow
+    if(value > (MAX_CONTENT_LENGTH - (*c - '0')) / 10)
+      exit(EXIT_HEADER_INCOMPLETE);
+    value = value * 10 + (*c - '0');
   }
+  *content_length = value;
 }
 
 cJSON* lsp_parse_content(unsigned long content_length) {
-  char *buffer = malloc(content_length + 1);
-  if(buffer == NULL)
-    exit(EXIT_OUT_OF_MEMORY);
-  size_t read_elements = fread(buffer, 1, content_length, stdin);
-  if(read_elements != content_length) {
-    free(buffer);
+  lsp_reserve_receive_buffer(content_length);
+  // Header is not timed, because reading it waits for the client
+  long long start = stats_now();
+  size_t read_elements = fread(receive_buffer, 1, content_length, stdin);
+  if(read_elements != content_length)
     exit(EXIT_IO_ERROR);
-  }
-  buffer[content_length] = '\0';
-
-  cJSON *request = cJSON_Parse(buffer);
+  stats_stage(STAGE_READ, start);
 
-  free(buffer);
+  // Parsed in place, the body is not copied or terminated
+  start = stats_now();
+  cJSON *request = cJSON_ParseWithLength(receive_buffer, content_length);
   if(request == NULL)
     exit(EXIT_PARSE_ERROR);
+  stats_stage(STAGE_DECODE, start);
   return request;
 }
 
@@ -71,80 +293,320 @@ void json_rpc(const cJSON *request) {
 
   const cJSON *params_json = cJSON_GetObjectItem(request, "params");
 
-  // RPC
-  if(strcmp(method, "initialize") == 0) {
-    lsp_initialize(id);
-  }
-  else if(strcmp(method, "shutdown") == 0) {
-    lsp_shutdown(id);
-  }
-  else if(strcmp(method, "exit") == 0) {
-    lsp_exit();
-  }
-  else if(strcmp(method, "textDocument/didOpen") == 0) {
-    lsp_sync_open(params_json);
-  }
-  else if(strcmp(method, "textDocument/didChange") == 0) {
-    lsp_sync_change(params_json);
+  long long start = stats_now();
+  const RPC_METHOD *rpc_method = lsp_find_method(method);
+  output_method = lsp_stats_slot(rpc_method);
+
+  // Published before the check, so a later cancellation raises the flag
+  atomic_store(&request_cancelled, 0);
+  atomic_store(&current_request, id);
+  if(id != -1 && lsp_take_cancelled(id)) {
+    lsp_send_error(id, REQUEST_CANCELLED, "Request cancelled");
   }
-  else if(strcmp(method, "textDocument/didClose") == 0) {
-    lsp_sync_close(params_json);
+  // RPC
+  else if(id != -1) {
+    if(rpc_method == NULL || rpc_method->request == NULL)
+      lsp_send_error(id, METHOD_NOT_FOUND, "Method not found");
+    else
+      rpc_method->request(id, params_json);
   }
-  else if(strcmp(method, "textDocument/hover") == 0) {
-    lsp_hover(id, params_json);
+  else if(rpc_method != NULL && rpc_method->notification != NULL) {
+    rpc_method->notification(params_json);
   }
-  else if(strcmp(method, "textDocument/definition") == 0) {
-    lsp_goto_definition(id, params_json);
+
+  stats_method(output_method, rpc_method != NULL ? rpc_method->method : NULL, id, start);
+  stats_stage(STAGE_DISPATCH, start);
+  output_method = STATS_OTHER_METHOD;
+}
+
+unsigned int lsp_method_hash(const char *method, unsigned int seed) {
+  unsigned int hash = 2166136261u ^ seed;
+  for(; *method != '\0'; method++) {
+    hash ^= (unsigned char) *method;
+    hash *= 16777619u;
   }
-  else if(strcmp(method, "textDocument/completion") == 0) {
-    lsp_completion(id, params_json);
+  return hash % RPC_SLOTS_LENGTH;
+}
+
+void lsp_dispatch_init(void) {
+  // Searches for a seed which gives every method its own slot
+  for(rpc_seed = 0;; rpc_seed++) {
+    memset(rpc_slots, 0, sizeof(rpc_slots));
+    size_t i;
+    for(i = 0; i < RPC_METHODS_NUM; i++) {
+      unsigned int slot = lsp_method_hash(rpc_methods[i].method, rpc_seed);
+      if(rpc_slots[slot] != 0)
+        break;
+      rpc_slots[slot] = i + 1;
+    }
+    if(i == RPC_METHODS_NUM)
+      return;
   }
 }
 
+int lsp_stats_slot(const RPC_METHOD *method) {
+  if(method == NULL || method - rpc_methods >= STATS_OTHER_METHOD)
+    return STATS_OTHER_METHOD;
+  return method - rpc_methods;
+}
+
+const RPC_METHOD* lsp_find_method(const char *method) {
+  int index = rpc_slots[lsp_method_hash(method, rpc_seed)];
+  if(index == 0 || strcmp(rpc_methods[index - 1].method, method) != 0)
+    return NULL;
+  return &rpc_methods[index - 1];
+}
+
 // *********************
 // LSP helper functions:
 // *********************
 
-DOCUMENT_LOCATION lsp_parse_document(const cJSON *params_json) {
-  DOCUMENT_LOCATION document;
-
+const char* lsp_parse_uri(const cJSON *params_json) {
   const cJSON *text_document_json = cJSON_GetObjectItem(params_json, "textDocument");
   const cJSON *uri_json = cJSON_GetObjectItem(text_document_json, "uri");
-  document.uri = cJSON_GetStringValue(uri_json);
-  if(document.uri == NULL) {
+  const char *uri = cJSON_GetStringValue(uri_json);
+  if(uri == NULL) {
     exit(EXIT_CONTENT_INCOMPLETE);
   }
+  return uri;
+}
+
+DOCUMENT_LOCATION lsp_parse_document(const cJSON *params_json) {
+  DOCUMENT_LOCATION document;
+
+  document.uri = lsp_parse_uri(params_json);
 
   const cJSON *position_json = cJSON_GetObjectItem(params_json, "position");
+  document.position = lsp_parse_position(position_json);
+
+  return document;
+}
+
+POSITION lsp_parse_position(const cJSON *position_json) {
+  POSITION position;
+
   const cJSON *line_json = cJSON_GetObjectItem(position_json, "line");
   if(!cJSON_IsNumber(line_json)) {
     exit(EXIT_CONTENT_INCOMPLETE);
   }
-  document.line = line_json->valueint;
+  position.line = line_json->valueint;
   const cJSON *character_json = cJSON_GetObjectItem(position_json, "character");
   if(!cJSON_IsNumber(character_json)) {
     exit(EXIT_CONTENT_INCOMPLETE);
   }
-  document.character = character_json->valueint;
+  position.character = character_json->valueint;
 
-  return document;
+  return position;
+}
+
+char* lsp_cursor_symbol(BUFFER *buffer, POSITION position) {
+  const char *text = buffer_content(buffer);
+  size_t length = buffer_prefix(buffer, position);
+  size_t symbol_length;
+  const char *symbol = extract_last_symbol(text, length, &symbol_length);
+  char *symbol_name = strndup(symbol, symbol_length);
+  if(symbol_name == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  return symbol_name;
+}
+
+int lsp_find_symbol(BUFFER *buffer, const SNAPSHOT *snapshot, POSITION position) {
+  long long start = stats_now();
+  int index = snapshot_symbol_at(snapshot, position);
+  if(index == -1) {
+    // Not resolved by the parser (e.g. after a syntax error), searched by name
+    char *symbol_name = lsp_cursor_symbol(buffer, position);
+    index = snapshot_lookup(snapshot, symbol_name, VAR|PAR|FUN, position);
+    free(symbol_name);
+  }
+  stats_stage(STAGE_LOOKUP, start);
+  return index;
+}
+
+static int hex_digit(char c) {
+  return isdigit((unsigned char) c) ? c - '0' : tolower((unsigned char) c) - 'a' + 10;
+}
+
+char* lsp_uri_path(const char *uri) {
+  if(strncmp(uri, "file://", 7) != 0)
+    return NULL;
+  uri += 7;
+  char *path = malloc(strlen(uri) + 1);
+  if(path == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  size_t length = 0;
+  for(; *uri != '\0'; uri++) {
+    // Incomplete escapes are copied literally
+    if(*uri == '%' && isxdigit((unsigned char) uri[1]) && isxdigit((unsigned char) uri[2])) {
+      path[length++] = hex_digit(uri[1]) << 4 | hex_digit(uri[2]);
+      uri += 2;
+    } else {
+      path[length++] = *uri;
+    }
+  }
+  path[length] = '\0';
+  return path;
+}
+
+char* lsp_path_uri(const char *path) {
+  // Each byte takes at most 3 characters
+  char *uri = malloc(strlen("file://") + strlen(path) * 3 + 1);
+  if(uri == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  size_t length = sprintf(uri, "file://");
+  for(; *path != '\0'; path++) {
+    unsigned char c = *path;
+    // Unreserved characters and separators are kept, as editors keep them
+    if(isalnum(c) || c == '/' || c == '-' || c == '.' || c == '_' || c == '~')
+      uri[length++] = c;
+    else
+      length += sprintf(uri + length, "%%%02X", c);
+  }
+  uri[length] = '\0';
+  return uri;
+}
+
+SNAPSHOT* lsp_snapshot(BUFFER *buffer) {
+  lock_buffer(buffer);
+  if(buffer->snapshot == NULL || buffer->snapshot->version != buffer->version) {
+    const char *text = buffer_content(buffer);
+    long long start = stats_now();
+    tokens_sync(&buffer->tokens, text, buffer->length);
+    stats_stage(STAGE_LEX, start);
+    start = stats_now();
+    SNAPSHOT *snapshot = parse_tokens(NULL, text, buffer->tokens.tokens,
+        buffer->tokens.tokens_num, &buffer->analysis, &request_cancelled);
+    stats_stage(STAGE_PARSE, start);
+    // Incomplete snapshot of a cancelled request is replaced on next use
+    snapshot->version = atomic_load(&request_cancelled) ? -1 : buffer->version;
+    snapshot_free(buffer->snapshot);
+    buffer->snapshot = snapshot;
+  }
+  return buffer->snapshot;
+}
+
+void lsp_semantic_result(BUFFER *buffer, int *data, size_t data_num, cJSON *result) {
+  free(buffer->semantic_tokens);
+  buffer->semantic_tokens = data;
+  buffer->semantic_tokens_num = data_num;
+  ++buffer->semantic_result;
+  char result_id[16];
+  snprintf(result_id, sizeof(result_id), "%d", buffer->semantic_result);
+  cJSON_AddStringToObject(result, "resultId", result_id);
+}
+
+void lsp_write(cJSON *message) {
+  pthread_mutex_lock(&output_lock);
+
+  // Serialized into the reusable buffer, grown until the message fits
+  long long start = stats_now();
+  while(!cJSON_PrintPreallocated(message, serialize_buffer, serialize_capacity, 0)) {
+    int new_capacity = serialize_capacity ? serialize_capacity * 2 : MIN_OUTPUT_CAPACITY;
+    char *new_buffer = realloc(serialize_buffer, new_capacity);
+    if(new_buffer == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+    serialize_buffer = new_buffer;
+    serialize_capacity = new_capacity;
+  }
+
+  stats_stage(STAGE_SERIALIZE, start);
+
+  char header[MAX_HEADER_FIELD_LEN];
+  size_t body_length = strlen(serialize_buffer);
+  size_t header_length = sprintf(header, "Content-Length: %zu\r\n\r\n", body_length);
+  stats_bytes_out(output_method, header_length + body_length);
+  lsp_output_append(&pending_output, header, header_length);
+  lsp_output_append(&pending_output, serialize_buffer, body_length);
+
+  // Thread which is already writing will also write this message
+  if(output_flushing) {
+    pthread_mutex_unlock(&output_lock);
+    return;
+  }
+
+  // Writes everything queued so far, including messages
+  // queued by other threads in the meantime, a batch per write
+  output_flushing = 1;
+  while(pending_output.length > 0) {
+    OUTPUT_BUFFER batch = pending_output;
+    pending_output = flushed_output;
+    pending_output.length = 0;
+    pthread_mutex_unlock(&output_lock);
+
+    start = stats_now();
+    for(size_t written = 0; written < batch.length;) {
+      ssize_t result = write(STDOUT_FILENO, batch.data + written, batch.length - written);
+      if(result < 0 && errno != EINTR)
+        exit(EXIT_IO_ERROR);
+      if(result > 0)
+        written += result;
+    }
+    stats_stage(STAGE_WRITE, start);
+
+    pthread_mutex_lock(&output_lock);
+    flushed_output = batch;
+  }
+  output_flushing = 0;
+  pthread_mutex_unlock(&output_lock);
+}
+
+void lsp_output_append(OUTPUT_BUFFER *output, const char *data, size_t length) {
+  if(output->length + length > output->capacity) {
+    size_t new_capacity = output->capacity ? output->capacity : MIN_OUTPUT_CAPACITY;
+    while(new_capacity < output->length + length)
+      new_capacity *= 2;
+    char *new_data = realloc(output->data, new_capacity);
+    if(new_data == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+    output->data = new_data;
+    output->capacity = new_capacity;
+  }
+  memcpy(output->data + output->length, data, length);
+  output->length += length;
 }
 
 void lsp_send_response(int id, cJSON *result) {
+  if(atomic_load(&request_cancelled) && id == atomic_load(&current_request)) {
+    cJSON_Delete(result);
+    lsp_send_error(id, REQUEST_CANCELLED, "Request cancelled");
+    return;
+  }
+
+  cJSON *response = cJSON_CreateObject();
+  cJSON_AddStringToObject(response, "jsonrpc", "2.0");
+  cJSON_AddNumberToObject(response, "id", id);
+  cJSON_AddItemToObject(response, "result", result != NULL ? result : cJSON_CreateNull());
+
+  lsp_write(response);
+  cJSON_Delete(response);
+}
+
+void lsp_send_error(int id, int code, const char *message) {
   cJSON *response = cJSON_CreateObject();
   cJSON_AddStringToObject(response, "jsonrpc", "2.0");
   cJSON_AddNumberToObject(response, "id", id);
-  if(result != NULL)
-    cJSON_AddItemToObject(response, "result", result);
-
-  char *output = cJSON_Print(response);
-  printf("Content-Length: %lu\r\n\r\n", strlen(output));
-  fwrite(output, 1, strlen(output), stdout);
-  fflush(stdout);
-  free(output);
+  cJSON *error = cJSON_AddObjectToObject(response, "error");
+  cJSON_AddNumberToObject(error, "code", code);
+  cJSON_AddStringToObject(error, "message", message);
+
+  lsp_write(response);
   cJSON_Delete(response);
 }
 
+int lsp_take_cancelled(int id) {
+  int found = 0;
+  pthread_mutex_lock(&cancel_lock);
+  unsigned int first = cancelled_num > CANCELLED_LENGTH ? cancelled_num - CANCELLED_LENGTH : 0;
+  for(unsigned int i = first; i < cancelled_num; i++) {
+    if(cancelled_ids[i % CANCELLED_LENGTH] == id) {
+      cancelled_ids[i % CANCELLED_LENGTH] = -1;
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&cancel_lock);
+  return found;
+}
+
 void lsp_send_notification(const char *method, cJSON *params) {
   cJSON *response = cJSON_CreateObject();
   cJSON_AddStringToObject(response, "jsonrpc", "2.0");
@@ -152,11 +614,7 @@ void lsp_send_notification(const char *method, cJSON *params) {
   if(params != NULL)
     cJSON_AddItemToObject(response, "params", params);
 
-  char *output = cJSON_Print(response);
-  printf("Content-Length: %lu\r\n\r\n", strlen(output));
-  fwrite(output, 1, strlen(output), stdout);
-  fflush(stdout);
-  free(output);
+  lsp_write(response);
   cJSON_Delete(response);
 }
 
@@ -164,23 +622,55 @@ void lsp_send_notification(const char *method, cJSON *params) {
 // RPC functions:
 // **************
 
-void lsp_initialize(int id) {
+void lsp_initialize(int id, const cJSON *params_json) {
+  const cJSON *options_json = cJSON_GetObjectItem(params_json, "initializationOptions");
+  const cJSON *delay_json = cJSON_GetObjectItem(options_json, "diagnosticsDelay");
+  if(cJSON_IsNumber(delay_json) && delay_json->valueint >= 0) {
+    diagnostics_delay = delay_json->valueint;
+  }
+
+  const char *root_uri = cJSON_GetStringValue(cJSON_GetObjectItem(params_json, "rootUri"));
+  char *root = root_uri != NULL ? lsp_uri_path(root_uri) : NULL;
+  const char *root_path = cJSON_GetStringValue(cJSON_GetObjectItem(params_json, "rootPath"));
+  if(root == NULL && root_path != NULL) {
+    root = strdup(root_path);
+    if(root == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+  }
+  if(root != NULL)
+    workspace_open(root);
+  free(root);
+
   cJSON *result = cJSON_CreateObject();
   cJSON *capabilities = cJSON_AddObjectToObject(result, "capabilities");
-  cJSON_AddNumberToObject(capabilities, "textDocumentSync", 1);
+  cJSON *sync = cJSON_AddObjectToObject(capabilities, "textDocumentSync");
+  cJSON_AddBoolToObject(sync, "openClose", 1);
+  cJSON_AddNumberToObject(sync, "change", 2);
+  cJSON_AddBoolToObject(sync, "save", 1);
   cJSON_AddBoolToObject(capabilities, "hoverProvider", 1);
   cJSON_AddBoolToObject(capabilities, "definitionProvider", 1);
   cJSON *completion = cJSON_AddObjectToObject(capabilities, "completionProvider");
-  cJSON_AddBoolToObject(completion, "resolveProvider", 0);
+  cJSON_AddBoolToObject(completion, "resolveProvider", 1);
+  cJSON_AddBoolToObject(capabilities, "referencesProvider", 1);
+  cJSON_AddBoolToObject(capabilities, "documentHighlightProvider", 1);
+  cJSON_AddBoolToObject(capabilities, "renameProvider", 1);
+  cJSON_AddBoolToObject(capabilities, "workspaceSymbolProvider", 1);
+  cJSON *semantic = cJSON_AddObjectToObject(capabilities, "semanticTokensProvider");
+  cJSON_AddItemToObject(semantic, "legend", semantic_tokens_legend());
+  cJSON_AddBoolToObject(semantic, "range", 1);
+  cJSON *full = cJSON_AddObjectToObject(semantic, "full");
+  cJSON_AddBoolToObject(full, "delta", 1);
 
   lsp_send_response(id, result);
 }
 
-void lsp_shutdown(int id) {
+void lsp_shutdown(int id, const cJSON *params_json) {
+  (void) params_json;
   lsp_send_response(id, NULL);
 }
 
-void lsp_exit(void) {
+void lsp_exit(const cJSON *params_json) {
+  (void) params_json;
   exit(0);
 }
 
@@ -193,12 +683,15 @@ void lsp_sync_open(const cJSON *params_json) {
   const cJSON *text_json = cJSON_GetObjectItem(text_document_json, "text");
   const char *text = cJSON_GetStringValue(text_json);
 
+  const cJSON *version_json = cJSON_GetObjectItem(text_document_json, "version");
+  int version = cJSON_IsNumber(version_json) ? version_json->valueint : 0;
+
   if(uri == NULL || text == NULL) {
     exit(EXIT_CONTENT_INCOMPLETE);
   }
 
-  BUFFER buffer = open_buffer(uri, text);
-  lsp_lint(buffer);
+  BUFFER *buffer = open_buffer(uri, text, version);
+  lsp_lint(buffer, 0);
 }
 
 void lsp_sync_change(const cJSON *params_json) {
@@ -207,17 +700,41 @@ void lsp_sync_change(const cJSON *params_json) {
   const cJSON *uri_json = cJSON_GetObjectItem(text_document_json, "uri");
   const char *uri = cJSON_GetStringValue(uri_json);
 
+  const cJSON *version_json = cJSON_GetObjectItem(text_document_json, "version");
+
   const cJSON *content_changes_json = cJSON_GetObjectItem(params_json, "contentChanges");
-  const cJSON *content_change_json = cJSON_GetArrayItem(content_changes_json, 0);
-  const cJSON *text_json = cJSON_GetObjectItem(content_change_json, "text");
-  const char *text = cJSON_GetStringValue(text_json);
 
-  if(uri == NULL || text == NULL) {
+  if(uri == NULL || !cJSON_IsArray(content_changes_json)) {
     exit(EXIT_CONTENT_INCOMPLETE);
   }
 
-  BUFFER buffer = update_buffer(uri, text);
-  lsp_lint(buffer);
+  BUFFER *buffer = get_buffer(uri);
+  // Changes are applied in order, each one to the result of the previous.
+  // The buffer stays locked, so analyses never see a part of the changes.
+  lock_buffer(buffer);
+  int version = cJSON_IsNumber(version_json) ? version_json->valueint : buffer->version + 1;
+  const cJSON *content_change_json;
+  cJSON_ArrayForEach(content_change_json, content_changes_json) {
+    const cJSON *text_json = cJSON_GetObjectItem(content_change_json, "text");
+    const char *text = cJSON_GetStringValue(text_json);
+    if(text == NULL) {
+      exit(EXIT_CONTENT_INCOMPLETE);
+    }
+
+    const cJSON *range_json = cJSON_GetObjectItem(content_change_json, "range");
+    if(range_json == NULL) {
+      update_buffer(uri, text, version);
+    }
+    else {
+      POSITION start = lsp_parse_position(cJSON_GetObjectItem(range_json, "start"));
+      POSITION end = lsp_parse_position(cJSON_GetObjectItem(range_json, "end"));
+      edit_buffer(buffer, start, end, text);
+    }
+  }
+  buffer->version = version;
+  unlock_buffer(buffer);
+
+  lsp_lint(buffer, diagnostics_delay);
 }
 
 void lsp_sync_close(const cJSON *params_json) {
@@ -234,12 +751,152 @@ void lsp_sync_close(const cJSON *params_json) {
   lsp_lint_clear(uri);
 }
 
-void lsp_lint(BUFFER buffer) {
+void lsp_lint(BUFFER *buffer, long delay) {
+  lock_buffer(buffer);
+  buffer->lint_due = monotonic_time() + delay;
+  switch(buffer->lint_state) {
+    case LINT_IDLE:
+      buffer->lint_state = LINT_QUEUED;
+      worker_schedule(lsp_lint_task, retain_buffer(buffer), delay);
+      break;
+    case LINT_QUEUED: // Queued task will see the latest version and due time
+      break;
+    case LINT_RUNNING: // Results of the running task are already outdated
+      buffer->lint_pending = 1;
+      atomic_store(&buffer->lint_cancelled, 1);
+      break;
+  }
+  unlock_buffer(buffer);
+}
+
+// Returns marks of diagnostics, and stores their number to `marks_num`.
+static DIAGNOSTIC_MARK* diagnostic_marks(const cJSON *diagnostics, size_t *marks_num) {
+  *marks_num = cJSON_GetArraySize(diagnostics);
+  DIAGNOSTIC_MARK *marks = malloc((*marks_num + 1) * sizeof(DIAGNOSTIC_MARK));
+  if(marks == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  size_t i = 0;
+  const cJSON *diagnostic;
+  cJSON_ArrayForEach(diagnostic, diagnostics) {
+    const cJSON *range = cJSON_GetObjectItem(diagnostic, "range");
+    const cJSON *start = cJSON_GetObjectItem(range, "start");
+    const cJSON *end = cJSON_GetObjectItem(range, "end");
+    unsigned long hash = hash_string(cJSON_GetStringValue(cJSON_GetObjectItem(diagnostic, "message")));
+    hash = hash * 31 + cJSON_GetObjectItem(diagnostic, "severity")->valueint;
+    hash = hash * 31 + cJSON_GetObjectItem(start, "character")->valueint;
+    hash = hash * 31 + cJSON_GetObjectItem(end, "character")->valueint;
+    marks[i++] = (DIAGNOSTIC_MARK) {
+      cJSON_GetObjectItem(start, "line")->valueint,
+      cJSON_GetObjectItem(end, "line")->valueint,
+      hash
+    };
+  }
+  return marks;
+}
+
+
+// Returns whether diagnostics are the ones the client shows, and remembers them otherwise.
+static int diagnostics_published(BUFFER *buffer, const cJSON *diagnostics, int version) {
+  size_t marks_num;
+  DIAGNOSTIC_MARK *marks = diagnostic_marks(diagnostics, &marks_num);
+  int published = buffer->diagnostics_published && marks_num == buffer->diagnostics_num;
+  for(size_t i = 0; published && i < marks_num; i++) {
+    published = marks[i].first_line == buffer->diagnostics[i].first_line
+      && marks[i].last_line == buffer->diagnostics[i].last_line
+      && marks[i].hash == buffer->diagnostics[i].hash;
+  }
+  if(published) {
+    free(marks);
+    return 1;
+  }
+  free(buffer->diagnostics);
+  buffer->diagnostics = marks;
+  buffer->diagnostics_num = marks_num;
+  // Lines of an older version can't be moved by edits which were made since
+  buffer->diagnostics_published = buffer->version == version;
+  return 0;
+}
+
+void lsp_lint_task(void *argument) {
+  BUFFER *buffer = argument;
+
+  lock_buffer(buffer);
+  long long delay = buffer->lint_due - monotonic_time();
+  if(delay > 0 && !buffer->closed) { // Postponed by a newer change
+    unlock_buffer(buffer);
+    worker_schedule(lsp_lint_task, buffer, delay);
+    return;
+  }
+  if(buffer->closed) {
+    buffer->lint_state = LINT_IDLE;
+    unlock_buffer(buffer);
+    release_buffer(buffer);
+    return;
+  }
+  buffer->lint_state = LINT_RUNNING;
+  buffer->lint_pending = 0;
+  atomic_store(&buffer->lint_cancelled, 0);
+  size_t length;
+  char *text = buffer_copy(buffer, &length);
+  int version = buffer->version;
+  // Tokens are copied, because edits change them while the text is parsed
+  long long start = stats_now();
+  tokens_sync(&buffer->tokens, text, length);
+  stats_stage(STAGE_LEX, start);
+  size_t tokens_num = buffer->tokens.tokens_num;
+  TOKEN *tokens = malloc((tokens_num + 1) * sizeof(TOKEN));
+  if(tokens == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  memcpy(tokens, buffer->tokens.tokens, tokens_num * sizeof(TOKEN));
+  // Taken while the text is parsed, so other analyses of the buffer don't use it
+  ANALYSIS_CACHE *analysis = buffer->analysis;
+  buffer->analysis = NULL;
+  unlock_buffer(buffer);
+
   cJSON *params = cJSON_CreateObject();
-  cJSON_AddStringToObject(params, "uri", buffer.uri);
+  cJSON_AddStringToObject(params, "uri", buffer->uri);
+  cJSON_AddNumberToObject(params, "version", version);
   cJSON *diagnostics = cJSON_AddArrayToObject(params, "diagnostics");
-  parse(diagnostics, buffer.content);
-  lsp_send_notification("textDocument/publishDiagnostics", params);
+  start = stats_now();
+  SNAPSHOT *snapshot = parse_tokens(diagnostics, text, tokens, tokens_num, &analysis,
+      &buffer->lint_cancelled);
+  stats_stage(STAGE_PARSE, start);
+  snapshot->version = version;
+  free(tokens);
+  free(text);
+
+  lock_buffer(buffer);
+  if(buffer->analysis == NULL) {
+    buffer->analysis = analysis;
+    analysis = NULL;
+  }
+  analysis_free(analysis);
+  if(!buffer->closed && !atomic_load(&buffer->lint_cancelled)) {
+    if(buffer->snapshot == NULL || buffer->snapshot->version <= version) {
+      snapshot_free(buffer->snapshot);
+      buffer->snapshot = snapshot;
+      snapshot = NULL;
+    }
+    // Published under the lock, so diagnostics of a closed buffer are never sent.
+    // Unchanged diagnostics, even if moved by edits, are not sent again.
+    if(!diagnostics_published(buffer, diagnostics, version)) {
+      lsp_send_notification("textDocument/publishDiagnostics", params);
+      params = NULL;
+    }
+  }
+  snapshot_free(snapshot);
+  cJSON_Delete(params);
+
+  if(buffer->lint_pending && !buffer->closed) {
+    buffer->lint_state = LINT_QUEUED;
+    delay = buffer->lint_due - monotonic_time();
+    unlock_buffer(buffer);
+    worker_schedule(lsp_lint_task, buffer, delay);
+    return;
+  }
+  buffer->lint_state = LINT_IDLE;
+  unlock_buffer(buffer);
+  release_buffer(buffer);
 }
 
 void lsp_lint_clear(const char *uri) {
@@ -252,12 +909,10 @@ void lsp_lint_clear(const char *uri) {
 void lsp_hover(int id, const cJSON *params_json) {
   DOCUMENT_LOCATION document = lsp_parse_document(params_json);
 
-  BUFFER buffer = get_buffer(document.uri);
-  char *text = strdup(buffer.content);
-  truncate_string(text, document.line, document.character);
-  const char *symbol_name  = extract_last_symbol(text);
-  cJSON *contents = symbol_info(symbol_name, text);
-  free(text);
+  BUFFER *buffer = get_buffer(document.uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  cJSON *contents = symbol_info(snapshot, lsp_find_symbol(buffer, snapshot, document.position));
+  unlock_buffer(buffer);
 
   if(contents == NULL) {
     lsp_send_response(id, NULL);
@@ -271,17 +926,18 @@ void lsp_hover(int id, const cJSON *params_json) {
 void lsp_goto_definition(int id, const cJSON *params_json) {
   DOCUMENT_LOCATION document = lsp_parse_document(params_json);
 
-  BUFFER buffer = get_buffer(document.uri);
-  char *text = strdup(buffer.content);
-  truncate_string(text, document.line, document.character);
-  const char *symbol_name  = extract_last_symbol(text);
-  cJSON *range = symbol_location(symbol_name, text);
-  free(text);
-
-  if(range == NULL) {
-    lsp_send_response(id, NULL);
+  BUFFER *buffer = get_buffer(document.uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  cJSON *range = symbol_location(snapshot, lsp_find_symbol(buffer, snapshot, document.position));
+  if(range == NULL) { // Not defined in the document, searched in the workspace
+    char *symbol_name = lsp_cursor_symbol(buffer, document.position);
+    unlock_buffer(buffer);
+    lsp_send_response(id, symbol_name[0] != '\0' ? workspace_definition(symbol_name) : NULL);
+    free(symbol_name);
     return;
   }
+  unlock_buffer(buffer);
+
   cJSON *result = cJSON_CreateObject();
   cJSON_AddStringToObject(result, "uri", document.uri);
   cJSON_AddItemToObject(result, "range", range);
@@ -291,12 +947,203 @@ void lsp_goto_definition(int id, const cJSON *params_json) {
 void lsp_completion(int id, const cJSON *params_json) {
   DOCUMENT_LOCATION document = lsp_parse_document(params_json);
 
-  BUFFER buffer = get_buffer(document.uri);
-  char *text = strdup(buffer.content);
-  truncate_string(text, document.line, document.character);
-  const char *symbol_name_part  = extract_last_symbol(text);
-  cJSON *result = symbol_completion(symbol_name_part, text);
-  free(text);
+  BUFFER *buffer = get_buffer(document.uri);
+  char *symbol_name_part = lsp_cursor_symbol(buffer, document.position);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  long long start = stats_now();
+  cJSON *result = symbol_completion(snapshot, symbol_name_part, document.position);
+  stats_stage(STAGE_LOOKUP, start);
+  unlock_buffer(buffer);
+  free(symbol_name_part);
+
+  lsp_send_response(id, result);
+}
+
+void lsp_completion_resolve(int id, const cJSON *params_json) {
+  cJSON *item = cJSON_Duplicate(params_json, 1);
+  if(item == NULL) {
+    exit(EXIT_CONTENT_INCOMPLETE);
+  }
+  symbol_resolve(item);
+
+  lsp_send_response(id, item);
+}
+
+void lsp_references(int id, const cJSON *params_json) {
+  DOCUMENT_LOCATION document = lsp_parse_document(params_json);
+  const cJSON *context_json = cJSON_GetObjectItem(params_json, "context");
+  const cJSON *include_declaration_json = cJSON_GetObjectItem(context_json, "includeDeclaration");
+  int include_declaration = !cJSON_IsFalse(include_declaration_json);
+
+  BUFFER *buffer = get_buffer(document.uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  int index = lsp_find_symbol(buffer, snapshot, document.position);
+  cJSON *result = symbol_references(snapshot, index, document.uri, include_declaration);
+  unlock_buffer(buffer);
+
+  lsp_send_response(id, result);
+}
+
+void lsp_document_highlight(int id, const cJSON *params_json) {
+  DOCUMENT_LOCATION document = lsp_parse_document(params_json);
+
+  BUFFER *buffer = get_buffer(document.uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  cJSON *result = symbol_highlights(snapshot, lsp_find_symbol(buffer, snapshot, document.position));
+  unlock_buffer(buffer);
 
   lsp_send_response(id, result);
 }
+
+void lsp_rename(int id, const cJSON *params_json) {
+  DOCUMENT_LOCATION document = lsp_parse_document(params_json);
+  const cJSON *new_name_json = cJSON_GetObjectItem(params_json, "newName");
+  const char *new_name = cJSON_GetStringValue(new_name_json);
+  if(new_name == NULL) {
+    exit(EXIT_CONTENT_INCOMPLETE);
+  }
+  if(!valid_identifier(new_name)) {
+    lsp_send_error(id, INVALID_PARAMS, "Invalid identifier");
+    return;
+  }
+
+  BUFFER *buffer = get_buffer(document.uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  int index = lsp_find_symbol(buffer, snapshot, document.position);
+  cJSON *result = symbol_rename(snapshot, index, document.uri, new_name);
+  unlock_buffer(buffer);
+
+  lsp_send_response(id, result);
+}
+
+void lsp_workspace_symbol(int id, const cJSON *params_json) {
+  const cJSON *query_json = cJSON_GetObjectItem(params_json, "query");
+  const char *query = cJSON_GetStringValue(query_json);
+  if(query == NULL) {
+    exit(EXIT_CONTENT_INCOMPLETE);
+  }
+
+  lsp_send_response(id, workspace_symbols(query));
+}
+
+// Indexes the workspace file with `uri` again.
+static void file_changed(const char *uri) {
+  char *path = lsp_uri_path(uri);
+  if(path != NULL)
+    workspace_file_changed(path);
+  free(path);
+}
+
+void lsp_sync_save(const cJSON *params_json) {
+  const cJSON *text_document_json = cJSON_GetObjectItem(params_json, "textDocument");
+
+  const cJSON *uri_json = cJSON_GetObjectItem(text_document_json, "uri");
+  const char *uri = cJSON_GetStringValue(uri_json);
+
+  if(uri == NULL) {
+    exit(EXIT_CONTENT_INCOMPLETE);
+  }
+
+  file_changed(uri);
+}
+
+void lsp_watched_files(const cJSON *params_json) {
+  const cJSON *changes_json = cJSON_GetObjectItem(params_json, "changes");
+  if(!cJSON_IsArray(changes_json)) {
+    exit(EXIT_CONTENT_INCOMPLETE);
+  }
+
+  // Created, changed and deleted files are told apart by their state on disk
+  const cJSON *change_json;
+  cJSON_ArrayForEach(change_json, changes_json) {
+    const char *uri = cJSON_GetStringValue(cJSON_GetObjectItem(change_json, "uri"));
+    if(uri != NULL)
+      file_changed(uri);
+  }
+}
+
+void lsp_semantic_tokens_full(int id, const cJSON *params_json) {
+  BUFFER *buffer = get_buffer(lsp_parse_uri(params_json));
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  size_t data_num;
+  // Tokens are in sync with the text of a current snapshot
+  int *data = semantic_tokens(snapshot, buffer->tokens.tokens, buffer->tokens.tokens_num,
+      (POSITION) { 0, 0 }, (POSITION) { INT_MAX, 0 }, &data_num);
+  cJSON *result = cJSON_CreateObject();
+  cJSON_AddItemToObject(result, "data", semantic_tokens_json(data, data_num));
+  lsp_semantic_result(buffer, data, data_num, result);
+  unlock_buffer(buffer);
+
+  lsp_send_response(id, result);
+}
+
+void lsp_semantic_tokens_delta(int id, const cJSON *params_json) {
+  const char *uri = lsp_parse_uri(params_json);
+  const cJSON *previous_json = cJSON_GetObjectItem(params_json, "previousResultId");
+  const char *previous = cJSON_GetStringValue(previous_json);
+  if(previous == NULL) {
+    exit(EXIT_CONTENT_INCOMPLETE);
+  }
+
+  BUFFER *buffer = get_buffer(uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  size_t data_num;
+  int *data = semantic_tokens(snapshot, buffer->tokens.tokens, buffer->tokens.tokens_num,
+      (POSITION) { 0, 0 }, (POSITION) { INT_MAX, 0 }, &data_num);
+  cJSON *result = cJSON_CreateObject();
+  char *end;
+  long previous_result = strtol(previous, &end, 10);
+  if(buffer->semantic_tokens != NULL && *end == '\0' && previous_result == buffer->semantic_result)
+    cJSON_AddItemToObject(result, "edits", semantic_tokens_edits(buffer->semantic_tokens,
+        buffer->semantic_tokens_num, data, data_num));
+  else // Unknown base, the client gets all tokens
+    cJSON_AddItemToObject(result, "data", semantic_tokens_json(data, data_num));
+  lsp_semantic_result(buffer, data, data_num, result);
+  unlock_buffer(buffer);
+
+  lsp_send_response(id, result);
+}
+
+void lsp_semantic_tokens_range(int id, const cJSON *params_json) {
+  const char *uri = lsp_parse_uri(params_json);
+  const cJSON *range = cJSON_GetObjectItem(params_json, "range");
+  POSITION start = lsp_parse_position(cJSON_GetObjectItem(range, "start"));
+  POSITION end = lsp_parse_position(cJSON_GetObjectItem(range, "end"));
+
+  BUFFER *buffer = get_buffer(uri);
+  SNAPSHOT *snapshot = lsp_snapshot(buffer);
+  size_t data_num;
+  int *data = semantic_tokens(snapshot, buffer->tokens.tokens, buffer->tokens.tokens_num,
+      start, end, &data_num);
+  unlock_buffer(buffer);
+
+  cJSON *result = cJSON_CreateObject();
+  cJSON_AddItemToObject(result, "data", semantic_tokens_json(data, data_num));
+  free(data);
+  lsp_send_response(id, result);
+}
+
+void lsp_stats(int id, const cJSON *params_json) {
+  (void) params_json;
+  const char *method_names[RPC_METHODS_NUM];
+  for(size_t i = 0; i < RPC_METHODS_NUM; i++)
+    method_names[i] = rpc_methods[i].method;
+  lsp_send_response(id, stats_json(method_names, RPC_METHODS_NUM));
+}
+
+void lsp_cancel_request(const cJSON *params_json) {
+  const cJSON *id_json = cJSON_GetObjectItem(params_json, "id");
+  if(!cJSON_IsNumber(id_json)) {
+    return;
+  }
+
+  int id = id_json->valueint;
+  pthread_mutex_lock(&cancel_lock);
+  cancelled_ids[cancelled_num % CANCELLED_LENGTH] = id;
+  ++cancelled_num;
+  pthread_mutex_unlock(&cancel_lock);
+
+  if(id == atomic_load(&current_request)) {
+    atomic_store(&request_cancelled, 1);
+  }
+}
@@ -3,19 +3,70 @@
 
 #include <cjson/cJSON.h>
 #include "io.h"
+#include "snapshot.h"
+
+// Default debounce window of diagnostics, in milliseconds
+#define DEFAULT_DIAGNOSTICS_DELAY 150
+
+// JSON-RPC error codes
+#define METHOD_NOT_FOUND -32601
+#define INVALID_PARAMS -32602
+#define REQUEST_CANCELLED -32800
+
+typedef struct {
+	const char *method;
+	void (*request)(int id, const cJSON *params_json);
+	void (*notification)(const cJSON *params_json);
+	int priority;        // Queued requests of higher priority are handled first
+	int writes_buffers;  // Changes buffers or the server state, so it is never reordered
+	int immediate;       // Handled by the reader thread, before queued messages
+} RPC_METHOD;
 
 /*
  * Main event loop.
+ * Handles messages queued by the reader thread, one at a time.
  */
 void lsp_event_loop(void);
 
+/*
+ * Reader thread: reads messages from stdin and queues them.
+ * Cancel notifications are handled as soon as they are read.
+ */
+void* lsp_reader(void *argument);
+
+/*
+ * Queues a message of `method` (NULL if unknown), waiting while the queue is full.
+ */
+void lsp_queue_push(cJSON *message, const RPC_METHOD *method);
+
+/*
+ * Takes a message from the queue, waiting while it is empty.
+ * The message of the highest priority is taken from those queued before
+ * the oldest message which writes buffers, or that message if it is the oldest.
+ */
+cJSON* lsp_queue_pop(void);
+
+/*
+ * Grows the receive buffer to at least `capacity` bytes.
+ * The buffer is kept for the following messages.
+ */
+void lsp_reserve_receive_buffer(size_t capacity);
+
 /*
  * Parses message header and returns the content length.
+ * Returns 0 at the end of input.
  */
 unsigned long lsp_parse_header(void);
 
 /*
- * Converts message body of specified length to cJSON object.
+ * Parses a header field of `length` bytes (without the line terminator).
+ * Stores value of the Content-Length field to `content_length`.
+ */
+void lsp_parse_header_field(const char *field, size_t length, unsigned long *content_length);
+
+/*
+ * Reads message body of specified length into the receive buffer,
+ * and converts it to cJSON object.
  *
  * WARNING: Caller is responsible to free the result.
  */
@@ -23,29 +74,134 @@ cJSON* lsp_parse_content(unsigned long content_length);
 
 /*
  * Parses RPC request and calls the appropriate function.
+ * Unknown requests get MethodNotFound error, unknown notifications are ignored.
  */
 void json_rpc(const cJSON *request);
 
+/*
+ * Returns hash of a method name, as a slot index of the dispatch table.
+ */
+unsigned int lsp_method_hash(const char *method, unsigned int seed);
+
+/*
+ * Builds a collision-free dispatch table of the supported methods.
+ */
+void lsp_dispatch_init(void);
+
+/*
+ * Returns statistics slot of a method (see `stats_method`).
+ * NULL method and methods without their own slot share the last one.
+ */
+int lsp_stats_slot(const RPC_METHOD *method);
+
+/*
+ * Searches a method by name, with a single string comparison.
+ * Returns NULL if the method is not supported.
+ */
+const RPC_METHOD* lsp_find_method(const char *method);
+
 // *********************
 // LSP helper functions:
 // *********************
 
 typedef struct {
 	const char *uri;
-	int line;
-	int character;
+	POSITION position;
 } DOCUMENT_LOCATION;
 
+/*
+ * Parses document URI from LSP request.
+ */
+const char* lsp_parse_uri(const cJSON *params_json);
+
 /*
  * Parses document location from LSP request.
  */
 DOCUMENT_LOCATION lsp_parse_document(const cJSON *params_json);
 
+/*
+ * Parses LSP position object.
+ */
+POSITION lsp_parse_position(const cJSON *position_json);
+
+/*
+ * Returns the symbol under the cursor at `position`.
+ *
+ * WARNING: Caller is responsible to free the result.
+ */
+char* lsp_cursor_symbol(BUFFER *buffer, POSITION position);
+
+/*
+ * Returns index of the snapshot symbol under the cursor at `position`, or -1.
+ * Occurrences resolved by the parser are searched first,
+ * then visible symbols with the name under the cursor.
+ */
+int lsp_find_symbol(BUFFER *buffer, const SNAPSHOT *snapshot, POSITION position);
+
+/*
+ * Locks the buffer and returns snapshot of its current version.
+ * The buffer is parsed again only if it changed since the last analysis.
+ *
+ * WARNING: Caller is responsible to unlock the buffer.
+ */
+SNAPSHOT* lsp_snapshot(BUFFER *buffer);
+
+/*
+ * Returns the path of a file `uri`, or NULL if it is not a file URI.
+ *
+ * WARNING: Caller is responsible to free the result.
+ */
+char* lsp_uri_path(const char *uri);
+
+/*
+ * Returns the file URI of an absolute `path`, which `lsp_uri_path` decodes back.
+ *
+ * WARNING: Caller is responsible to free the result.
+ */
+char* lsp_path_uri(const char *path);
+
+/*
+ * Keeps encoded semantic tokens as the last result of the buffer,
+ * and adds its new result id to `result`.
+ * The buffer must be locked, and takes ownership of `data`.
+ */
+void lsp_semantic_result(BUFFER *buffer, int *data, size_t data_num, cJSON *result);
+
+typedef struct {
+	char *data;
+	size_t length;
+	size_t capacity;
+} OUTPUT_BUFFER;
+
+/*
+ * Writes a message to stdout, in compact form.
+ * Safe to call from any thread; messages are never interleaved.
+ * Messages written concurrently are batched into a single write.
+ */
+void lsp_write(cJSON *message);
+
+/*
+ * Appends `length` bytes of `data` to an output buffer.
+ */
+void lsp_output_append(OUTPUT_BUFFER *output, const char *data, size_t length);
+
 /*
  * Sends a LSP message response.
+ * NULL `result` is sent as null.
+ * Sends an error instead if the request was cancelled while being handled.
  */
 void lsp_send_response(int id, cJSON *result);
 
+/*
+ * Sends a LSP error response.
+ */
+void lsp_send_error(int id, int code, const char *message);
+
+/*
+ * Checks if request with `id` was cancelled, and forgets the cancellation.
+ */
+int lsp_take_cancelled(int id);
+
 /*
  * Sends a LSP notification.
  */
@@ -58,18 +214,21 @@ void lsp_send_notification(const char *method, cJSON *params);
 /*
  * Parses LSP initialize request, and sends a response accordingly.
  * Response specifies language server's capabilities.
+ *
+ * Supported `initializationOptions`:
+ *   diagnosticsDelay - milliseconds without changes before a document is linted
  */
-void lsp_initialize(int id);
+void lsp_initialize(int id, const cJSON *params_json);
 
 /*
  * Parses LSP shutdown request, and sends a response.
  */
-void lsp_shutdown(int id);
+void lsp_shutdown(int id, const cJSON *params_json);
 
 /*
  * Stops the language server.
  */
-void lsp_exit(void);
+void lsp_exit(const cJSON *params_json);
 
 /*
  * Parses LSP text sync notifications, and updates buffers and diagnostics.
@@ -79,9 +238,16 @@ void lsp_sync_change(const cJSON *params_json);
 void lsp_sync_close(const cJSON *params_json);
 
 /*
- * Runs a linter and returns LSP publish diagnostics notification.
+ * Schedules a linter run on a worker thread, `delay` milliseconds from now.
+ * At most one run per buffer is queued or running at a time.
+ * A newer call postpones the queued run, or cancels the running one.
+ */
+void lsp_lint(BUFFER *buffer, long delay);
+
+/*
+ * Runs a linter and sends LSP publish diagnostics notification.
  */
-void lsp_lint(BUFFER buffer);
+void lsp_lint_task(void *argument);
 
 /*
  * Clears diagnostics for a file with specified `uri`.
@@ -103,4 +269,58 @@ void lsp_goto_definition(int id, const cJSON *params_json);
  */
 void lsp_completion(int id, const cJSON *params_json);
 
+/*
+ * Parses LSP completion item resolve request, and returns the item with detail.
+ */
+void lsp_completion_resolve(int id, const cJSON *params_json);
+
+/*
+ * Parses LSP references request, and returns all occurrences of the symbol.
+ */
+void lsp_references(int id, const cJSON *params_json);
+
+/*
+ * Parses LSP document highlight request, and returns all occurrences
+ * of the symbol, marking definitions and assignments as writes.
+ */
+void lsp_document_highlight(int id, const cJSON *params_json);
+
+/*
+ * Parses LSP rename request, and returns edits of all occurrences of the symbol.
+ */
+void lsp_rename(int id, const cJSON *params_json);
+
+/*
+ * Parses LSP workspace symbol request, and returns matching functions
+ * of all workspace files.
+ */
+void lsp_workspace_symbol(int id, const cJSON *params_json);
+
+/*
+ * Parses LSP save and watched files notifications, and indexes
+ * the changed workspace files again.
+ */
+void lsp_sync_save(const cJSON *params_json);
+void lsp_watched_files(const cJSON *params_json);
+
+/*
+ * Parses LSP semantic tokens requests, and returns tokens of the whole document
+ * or of a range. Delta request returns only changes since the result
+ * with `previousResultId`, if it was the last result of the document.
+ */
+void lsp_semantic_tokens_full(int id, const cJSON *params_json);
+void lsp_semantic_tokens_delta(int id, const cJSON *params_json);
+void lsp_semantic_tokens_range(int id, const cJSON *params_json);
+
+/*
+ * Parses `$/minic/stats` request, and returns counters and latency histograms
+ * of the pipeline stages and of every method.
+ */
+void lsp_stats(int id, const cJSON *params_json);
+
+/*
+ * Parses LSP cancel notification, and marks the request as cancelled.
+ */
+void lsp_cancel_request(const cJSON *params_json);
+
 #endif /* end of include guard: LSP_H */
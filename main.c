@@ -1,6 +1,56 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "err_codes.h"
+#include "check.h"
+#include "stats.h"
 #include "lsp.h"
 
-int main() {
+static void usage(const char *program) {
+  fprintf(stderr,
+      "Usage:\n"
+      "  %s [--stdio] [--trace <file>]\n"
+      "    Language server, speaking LSP over stdin and stdout.\n"
+      "  %s --check [-j<jobs>] [--format=jsonl|sarif] <files>...\n"
+      "    Lints files in parallel, and writes their diagnostics to stdout.\n",
+      program, program);
+  exit(EXIT_USAGE);
+}
+
+int main(int argc, char **argv) {
+  const char *program = argv[0];
+  int check = 0;
+  int jobs = 0;
+  enum check_format format = CHECK_JSONL;
+  int files_num = 0;
+  for(int i = 1; i < argc; i++) {
+    // Trace of the message pipeline, which must not go to stdout
+    if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      stats_open_trace(argv[++i]);
+    else if(strncmp(argv[i], "--trace=", 8) == 0)
+      stats_open_trace(argv[i] + 8);
+    else if(strcmp(argv[i], "--check") == 0)
+      check = 1;
+    else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if(strncmp(argv[i], "-j", 2) == 0)
+      jobs = atoi(argv[i] + 2);
+    else if(strcmp(argv[i], "--format=sarif") == 0)
+      format = CHECK_SARIF;
+    else if(strcmp(argv[i], "--format=jsonl") == 0)
+      format = CHECK_JSONL;
+    else if(strcmp(argv[i], "--stdio") == 0) // Passed by some clients, stdio is the only transport
+      continue;
+    else if(argv[i][0] != '-')
+      argv[files_num++] = argv[i]; // Files are collected in place
+    else
+      usage(program);
+  }
+
+  if(check != (files_num > 0))
+    usage(program);
+  if(check)
+    return check_files(argv, files_num, jobs, format);
   lsp_event_loop();
   return 0;
 }
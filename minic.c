@@ -1,76 +1,288 @@
+#include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include "defs.h"
+#include "err_codes.h"
+#include "hash.h"
 #include "symtab.h"
+#include "context.h"
 #include "minic.h"
 #include "minic.tab.h"
+#include "io.h"
 
-extern int yylineno;
-int yyparse(void);
-typedef struct yy_buffer_state * YY_BUFFER_STATE;
-YY_BUFFER_STATE yy_scan_string(const char *str);
-void yy_delete_buffer(YY_BUFFER_STATE buffer);
-
-char char_buffer[CHAR_BUFFER_LENGTH];
-int severity = ERROR;
-
-cJSON *_diagnostics = NULL;
-
-int yyerror(const char *text) {
-  if(_diagnostics == NULL) {
-    return 0;
+void report(PARSE_CONTEXT *ctx, int severity, SYMBOL_RANGE range, const char *format, ...) {
+  if(ctx->diagnostics == NULL) {
+    return;
   }
+  char message[CHAR_BUFFER_LENGTH];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, CHAR_BUFFER_LENGTH, format, args);
+  va_end(args);
+
   cJSON *diagnostic = cJSON_CreateObject();
 
   // Range
-  cJSON *range = cJSON_AddObjectToObject(diagnostic, "range");
-  cJSON *start_position = cJSON_AddObjectToObject(range, "start");
-  cJSON_AddNumberToObject(start_position, "line", yylloc.first_line);
+  cJSON *range_json = cJSON_AddObjectToObject(diagnostic, "range");
+  cJSON *start_position = cJSON_AddObjectToObject(range_json, "start");
+  cJSON_AddNumberToObject(start_position, "line", range.first_line);
   cJSON_AddNumberToObject(start_position, "character", 0);
-  cJSON *end_position = cJSON_AddObjectToObject(range, "end");
-  cJSON_AddNumberToObject(end_position, "line", yylloc.last_line);
-  cJSON_AddNumberToObject(end_position, "character", yylloc.last_column);
+  cJSON *end_position = cJSON_AddObjectToObject(range_json, "end");
+  cJSON_AddNumberToObject(end_position, "line", range.last_line);
+  cJSON_AddNumberToObject(end_position, "character", range.last_column);
   // Severity
   cJSON_AddNumberToObject(diagnostic, "severity", severity);
   // Message
-  cJSON_AddStringToObject(diagnostic, "message", text);
+  cJSON_AddStringToObject(diagnostic, "message", message);
+
+  cJSON_AddItemToArray(ctx->diagnostics, diagnostic);
+}
 
-  cJSON_AddItemToArray(_diagnostics, diagnostic);
+int yyerror(YYLTYPE *yylloc, PARSE_CONTEXT *ctx, const char *text) {
+  report(ctx, ERROR, (SYMBOL_RANGE) RANGE((*yylloc)), "%s", text);
+  return 0;
+}
 
-  severity = ERROR;
+int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, PARSE_CONTEXT *ctx) {
+  while(ctx->next_token < ctx->tokens_num) {
+    if(ctx->cancelled != NULL && atomic_load(ctx->cancelled))
+      return 0;
+    const TOKEN *token = &ctx->tokens[ctx->next_token++];
+    yylloc->first_line = yylloc->last_line = token->line;
+    yylloc->first_column = token->column;
+    yylloc->last_column = token->column + token->length;
+    const char *token_text = ctx->text + token->offset;
+    switch(token->kind) {
+      case TOKEN_INVALID:
+        report(ctx, ERROR, (SYMBOL_RANGE) RANGE((*yylloc)),
+            "lexical error on char '%c'", *token_text);
+        continue;
+      case _ID:
+      case _INT_NUMBER:
+        yylval->s = arena_intern(ctx->arena, token_text, token->length);
+        break;
+      case _UINT_NUMBER: // Without the suffix
+        yylval->s = arena_intern(ctx->arena, token_text, token->length - 1);
+        break;
+      default:
+        yylval->i = token->value;
+    }
+    return token->kind;
+  }
   return 0;
 }
 
-void parse(cJSON *diagnostics, const char *text) {
-  _diagnostics = diagnostics;
-  init_symtab();
-  yylineno = 0;
-  YY_BUFFER_STATE buffer = yy_scan_string(text);
-  yyparse();
-  yy_delete_buffer(buffer);
-  _diagnostics = NULL;
+SNAPSHOT* parse(cJSON *diagnostics, const char *text, size_t length,
+    const atomic_int *cancelled) {
+  TOKEN_STREAM stream = { 0 };
+  tokens_sync(&stream, text, length);
+  SNAPSHOT *snapshot = parse_tokens(diagnostics, text, stream.tokens, stream.tokens_num,
+      NULL, cancelled);
+  tokens_free(&stream);
+  return snapshot;
 }
 
-cJSON* symbol_info(const char *symbol_name, const char *text) {
-  parse(NULL, text);
-  int idx = lookup_symbol(symbol_name, VAR|PAR|FUN);
-  if(idx == -1) {
+// Returns number of tokens of the top-level function which begins with `tokens`:
+// up to the closing bracket of its body, and invalid characters at the end of text.
+static size_t function_length(const TOKEN *tokens, size_t tokens_num) {
+  int depth = 0;
+  for(size_t i = 0; i < tokens_num; i++) {
+    if(tokens[i].kind == _LBRACKET) {
+      ++depth;
+    }
+    else if(tokens[i].kind == _RBRACKET && --depth <= 0) {
+      size_t end = i + 1;
+      while(end < tokens_num && tokens[end].kind == TOKEN_INVALID)
+        ++end;
+      return end == tokens_num ? end : i + 1;
+    }
+  }
+  return tokens_num;
+}
+
+// Adds signature of a function to the hash of signatures before it.
+static unsigned long add_signature(unsigned long signature, const SYMBOL_ENTRY *function) {
+  unsigned long values[] = { hash_string(function->name), function->type,
+                             function->atr1, function->atr2 };
+  for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    signature = (signature ^ values[i]) * 1099511628211UL;
+  return signature;
+}
+
+// Returns hash of signatures of all functions in the symbol table.
+static unsigned long symtab_signature(SYMTAB *symtab) {
+  unsigned long signature = 0;
+  for(int i = FUN_REG + 1; i <= get_last_element(symtab); i++)
+    if(get_kind(symtab, i) == FUN)
+      signature = add_signature(signature, &symtab->table[i]);
+  return signature;
+}
+
+// Moves lines of all diagnostics by `lines`.
+static void move_diagnostics(cJSON *diagnostics, int lines) {
+  cJSON *diagnostic;
+  cJSON_ArrayForEach(diagnostic, diagnostics) {
+    cJSON *range = cJSON_GetObjectItem(diagnostic, "range");
+    cJSON *start = cJSON_GetObjectItem(cJSON_GetObjectItem(range, "start"), "line");
+    cJSON *end = cJSON_GetObjectItem(cJSON_GetObjectItem(range, "end"), "line");
+    cJSON_SetNumberValue(start, start->valueint + lines);
+    cJSON_SetNumberValue(end, end->valueint + lines);
+  }
+}
+
+// Adds cached results of a function instead of checking it again.
+static void reuse_function(PARSE_CONTEXT *ctx, const FUNCTION_RESULT *result, int line) {
+  SYMBOL_ENTRY function = result->function;
+  function.range.first_line += line;
+  function.range.last_line += line;
+  insert_symbol(&ctx->symtab, arena_intern(ctx->arena, function.name, strlen(function.name)),
+      FUN, function.type, function.atr1, function.atr2, function.range);
+  snapshot_append(ctx->snapshot, result->snapshot, 0, 0, 0, line);
+  cJSON *diagnostics = cJSON_Duplicate(result->diagnostics, 1);
+  move_diagnostics(diagnostics, line);
+  while(cJSON_GetArraySize(diagnostics) > 0)
+    cJSON_AddItemToArray(ctx->diagnostics, cJSON_DetachItemFromArray(diagnostics, 0));
+  cJSON_Delete(diagnostics);
+}
+
+SNAPSHOT* parse_tokens(cJSON *diagnostics, const char *text, const TOKEN *tokens,
+    size_t tokens_num, ANALYSIS_CACHE **cache, const atomic_int *cancelled) {
+  PARSE_CONTEXT *ctx = calloc(1, sizeof(PARSE_CONTEXT));
+  if(ctx == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  ctx->snapshot = snapshot_create();
+  ctx->fun_idx = -1;
+  ctx->fcall_idx = -1;
+  ctx->text = text;
+  ctx->cancelled = cancelled;
+  ctx->arena = arena_create();
+  ctx->snapshot->arena = ctx->arena;
+  init_symtab(&ctx->symtab);
+  ANALYSIS_CACHE *old_cache = cache != NULL ? *cache : NULL;
+  ANALYSIS_CACHE *new_cache = cache != NULL ? analysis_create() : NULL;
+  // Results are collected even if not reported, to be cached
+  cJSON *collected = diagnostics != NULL ? diagnostics : cJSON_CreateArray();
+
+  // Every function is checked on its own, with functions before it in the symbol table.
+  // Results of a function are cached, unless they changed the earlier symbols.
+  unsigned long signature = 0;
+  int syntax_error = 0;
+  size_t begin = 0;
+  do {
+    if(cancelled != NULL && atomic_load(cancelled))
+      break;
+    size_t length = function_length(tokens + begin, tokens_num - begin);
+    int line = length > 0 ? tokens[begin].line : 0;
+    unsigned long key = 0;
+    if(length > 0) {
+      const TOKEN *last = &tokens[begin + length - 1];
+      key = hash_bytes(text + tokens[begin].offset,
+          last->offset + last->length - tokens[begin].offset);
+      key = (key ^ (unsigned long) tokens[begin].column) * 1099511628211UL;
+      key = ((key ^ signature) * 1099511628211UL) | 1;
+    }
+
+    FUNCTION_RESULT *result = analysis_find(old_cache, key);
+    if(result != NULL) {
+      ctx->diagnostics = collected;
+      reuse_function(ctx, result, line);
+      signature = add_signature(signature, &result->function);
+      analysis_move(new_cache, result);
+      begin += length;
+      continue;
+    }
+
+    int symbols_begin = ctx->snapshot->symbols_num;
+    int occurrences_begin = ctx->snapshot->occurrences_num;
+    int pending_begin = ctx->snapshot->pending_num;
+    int symtab_end = get_last_element(&ctx->symtab);
+    ctx->diagnostics = cJSON_CreateArray();
+    ctx->tokens = tokens + begin;
+    ctx->tokens_num = length;
+    ctx->next_token = 0;
+    syntax_error = yyparse(ctx) != 0;
+
+    int added = get_last_element(&ctx->symtab) == symtab_end + 1;
+    if(new_cache != NULL && added && !syntax_error
+       && !(cancelled != NULL && atomic_load(cancelled))) {
+      FUNCTION_RESULT new_result = { .key = key };
+      new_result.function = ctx->symtab.table[symtab_end + 1];
+      new_result.function.range.first_line -= line;
+      new_result.function.range.last_line -= line;
+      new_result.snapshot = snapshot_create();
+      new_result.snapshot->arena = arena_create();
+      new_result.function.name = arena_intern(new_result.snapshot->arena,
+          new_result.function.name, strlen(new_result.function.name));
+      snapshot_append(new_result.snapshot, ctx->snapshot, symbols_begin, occurrences_begin,
+          pending_begin, -line);
+      new_result.diagnostics = cJSON_Duplicate(ctx->diagnostics, 1);
+      move_diagnostics(new_result.diagnostics, -line);
+      analysis_move(new_cache, &new_result);
+    }
+    while(cJSON_GetArraySize(ctx->diagnostics) > 0)
+      cJSON_AddItemToArray(collected, cJSON_DetachItemFromArray(ctx->diagnostics, 0));
+    cJSON_Delete(ctx->diagnostics);
+
+    if(added)
+      signature = add_signature(signature, &ctx->symtab.table[symtab_end + 1]);
+    else // Redefinition removed functions after the redefined one
+      signature = symtab_signature(&ctx->symtab);
+    begin += length;
+  } while(begin < tokens_num && !syntax_error);
+  ctx->diagnostics = collected;
+
+  if(!syntax_error && !(cancelled != NULL && atomic_load(cancelled))) {
+    SYMBOL_RANGE end = NO_RANGE;
+    if(tokens_num > 0) {
+      const TOKEN *last = &tokens[tokens_num - 1];
+      end = (SYMBOL_RANGE) { last->line, last->column, last->line,
+                             (int) (last->column + last->length) };
+    }
+    int idx = lookup_symbol(&ctx->symtab, arena_intern(ctx->arena, "main", 4), FUN);
+    if(idx == -1)
+      report(ctx, ERROR, end, "undefined reference to 'main'");
+    else
+      if(get_type(&ctx->symtab, idx) != INT)
+        report(ctx, WARNING, end, "return type of 'main' is not int");
+  }
+
+  // Functions, and symbols left in scope by a syntax error, are visible till the end
+  POSITION document_end = { INT_MAX, INT_MAX };
+  snapshot_record(ctx->snapshot, &ctx->symtab, FUN_REG + 1, document_end);
+  snapshot_index(ctx->snapshot);
+
+  if(cache != NULL) {
+    if(old_cache != NULL && cancelled != NULL && atomic_load(cancelled)) {
+      // Results of functions which were not reached are kept
+      for(int i = 0; i < old_cache->results_num; i++)
+        if(old_cache->results[i].key != 0)
+          analysis_move(new_cache, &old_cache->results[i]);
+    }
+    analysis_free(old_cache);
+    *cache = new_cache;
+  }
+  if(collected != diagnostics)
+    cJSON_Delete(collected);
+  SNAPSHOT *snapshot = ctx->snapshot;
+  clear_symtab(&ctx->symtab);
+  free(ctx);
+  return snapshot;
+}
+
+cJSON* symbol_info(const SNAPSHOT *snapshot, int index) {
+  if(index == -1) {
     return NULL;
   }
-  char *display = get_display(idx);
+  char *display = entry_display(&snapshot->symbols[index].entry);
   cJSON *info = cJSON_CreateString(display);
   free(display);
   return info;
 }
 
-cJSON* symbol_location(const char *symbol_name, const char *text) {
-  parse(NULL, text);
-  int idx = lookup_symbol(symbol_name, VAR|PAR|FUN);
-  if(idx == -1) {
-    return NULL;
-  }
-  SYMBOL_RANGE sym_range = get_range(idx);
-
+cJSON* range_json(SYMBOL_RANGE sym_range) {
   cJSON *range = cJSON_CreateObject();
   cJSON *start_position = cJSON_AddObjectToObject(range, "start");
   cJSON_AddNumberToObject(start_position, "line", sym_range.first_line);
@@ -81,19 +293,292 @@ cJSON* symbol_location(const char *symbol_name, const char *text) {
   return range;
 }
 
-cJSON* symbol_completion(const char *symbol_name_part, const char *text) {
-  parse(NULL, text);
-  int indices[SYMBOL_TABLE_LENGTH];
-  int indices_num = lookup_starts_with(indices, symbol_name_part);
+cJSON* symbol_location(const SNAPSHOT *snapshot, int index) {
+  if(index == -1) {
+    return NULL;
+  }
+  return range_json(snapshot->symbols[index].entry.range);
+}
 
-  cJSON *results = cJSON_CreateArray();
-  for(int i = 0; i < indices_num; i++) {
+// Checks if an occurrence is the definition of its symbol.
+static int is_definition(const SNAPSHOT *snapshot, const SNAPSHOT_OCCURRENCE *occurrence) {
+  SYMBOL_RANGE definition = snapshot->symbols[occurrence->symbol].entry.range;
+  return occurrence->range.first_line == definition.first_line
+    && occurrence->range.first_column == definition.first_column;
+}
+
+cJSON* symbol_references(const SNAPSHOT *snapshot, int index, const char *uri,
+    int include_declaration) {
+  cJSON *locations = cJSON_CreateArray();
+  if(index == -1) {
+    return locations;
+  }
+  for(int i = snapshot->references_start[index]; i < snapshot->references_start[index + 1]; i++) {
+    const SNAPSHOT_OCCURRENCE *occurrence = &snapshot->occurrences[snapshot->references[i]];
+    if(!include_declaration && is_definition(snapshot, occurrence))
+      continue;
+    cJSON *location = cJSON_CreateObject();
+    cJSON_AddStringToObject(location, "uri", uri);
+    cJSON_AddItemToObject(location, "range", range_json(occurrence->range));
+    cJSON_AddItemToArray(locations, location);
+  }
+  return locations;
+}
+
+cJSON* symbol_highlights(const SNAPSHOT *snapshot, int index) {
+  cJSON *highlights = cJSON_CreateArray();
+  if(index == -1) {
+    return highlights;
+  }
+  for(int i = snapshot->references_start[index]; i < snapshot->references_start[index + 1]; i++) {
+    const SNAPSHOT_OCCURRENCE *occurrence = &snapshot->occurrences[snapshot->references[i]];
+    cJSON *highlight = cJSON_CreateObject();
+    cJSON_AddItemToObject(highlight, "range", range_json(occurrence->range));
+    cJSON_AddNumberToObject(highlight, "kind",
+        occurrence->access == WRITE_ACCESS ? HIGHLIGHT_WRITE : HIGHLIGHT_READ);
+    cJSON_AddItemToArray(highlights, highlight);
+  }
+  return highlights;
+}
+
+cJSON* symbol_rename(const SNAPSHOT *snapshot, int index, const char *uri,
+    const char *new_name) {
+  if(index == -1) {
+    return NULL;
+  }
+  cJSON *workspace_edit = cJSON_CreateObject();
+  cJSON *changes = cJSON_AddObjectToObject(workspace_edit, "changes");
+  cJSON *edits = cJSON_AddArrayToObject(changes, uri);
+  for(int i = snapshot->references_start[index]; i < snapshot->references_start[index + 1]; i++) {
+    const SNAPSHOT_OCCURRENCE *occurrence = &snapshot->occurrences[snapshot->references[i]];
+    cJSON *edit = cJSON_CreateObject();
+    cJSON_AddItemToObject(edit, "range", range_json(occurrence->range));
+    cJSON_AddStringToObject(edit, "newText", new_name);
+    cJSON_AddItemToArray(edits, edit);
+  }
+  return workspace_edit;
+}
+
+int valid_identifier(const char *name) {
+  static const char *keywords[] = { "int", "unsigned", "if", "else", "return" };
+  if(!isalpha((unsigned char) name[0]))
+    return 0;
+  for(const char *c = name; *c != '\0'; c++) {
+    if(!isalnum((unsigned char) *c))
+      return 0;
+  }
+  for(size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+    if(strcmp(name, keywords[i]) == 0)
+      return 0;
+  }
+  return 1;
+}
+
+cJSON* symbol_completion(const SNAPSHOT *snapshot, const char *symbol_name_part,
+    POSITION position) {
+  SNAPSHOT_MATCH *matches = malloc((snapshot->symbols_num + 1) * sizeof(SNAPSHOT_MATCH));
+  if(matches == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  int matches_num = snapshot_complete(snapshot, matches, symbol_name_part, position,
+      COMPLETION_LIMIT);
+
+  cJSON *results = cJSON_CreateObject();
+  cJSON_AddBoolToObject(results, "isIncomplete", matches_num > COMPLETION_LIMIT);
+  cJSON *items = cJSON_AddArrayToObject(results, "items");
+  for(int i = 0; i < matches_num && i < COMPLETION_LIMIT; i++) {
+    const SYMBOL_ENTRY *entry = &snapshot->symbols[matches[i].index].entry;
     cJSON *item = cJSON_CreateObject();
-    cJSON_AddStringToObject(item, "label", get_name(indices[i]));
-    char *detail = get_display(indices[i]);
-    cJSON_AddStringToObject(item, "detail", detail);
-    free(detail);
-    cJSON_AddItemToArray(results, item);
+    cJSON_AddStringToObject(item, "label", entry->name);
+    cJSON_AddNumberToObject(item, "kind", entry->kind == FUN ? COMPLETION_FUNCTION : COMPLETION_VARIABLE);
+    char sort_text[16];
+    sprintf(sort_text, "%04d", i);
+    cJSON_AddStringToObject(item, "sortText", sort_text);
+    // Detail is made from these by `symbol_resolve`
+    int data[] = { entry->kind, entry->type, entry->atr1, entry->atr2 };
+    cJSON_AddItemToObject(item, "data", cJSON_CreateIntArray(data, 4));
+    cJSON_AddItemToArray(items, item);
   }
+  free(matches);
   return results;
 }
+
+void symbol_resolve(cJSON *item) {
+  const cJSON *label_json = cJSON_GetObjectItem(item, "label");
+  const cJSON *data_json = cJSON_GetObjectItem(item, "data");
+  if(!cJSON_IsString(label_json) || cJSON_GetArraySize(data_json) != 4)
+    return;
+
+  SYMBOL_ENTRY entry = {
+    label_json->valuestring,
+    cJSON_GetArrayItem(data_json, 0)->valueint,
+    cJSON_GetArrayItem(data_json, 1)->valueint,
+    cJSON_GetArrayItem(data_json, 2)->valueint,
+    cJSON_GetArrayItem(data_json, 3)->valueint,
+    NO_RANGE
+  };
+  if(entry.type > UINT || entry.atr2 > UINT)
+    return;
+  char *detail = entry_display(&entry);
+  cJSON_DeleteItemFromObject(item, "detail");
+  cJSON_AddStringToObject(item, "detail", detail);
+  free(detail);
+}
+
+cJSON* semantic_tokens_legend(void) {
+  static const char *types[] = {
+    "function", "parameter", "variable", "number", "keyword", "type", "operator"
+  };
+  cJSON *legend = cJSON_CreateObject();
+  cJSON *types_json = cJSON_AddArrayToObject(legend, "tokenTypes");
+  for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    cJSON_AddItemToArray(types_json, cJSON_CreateString(types[i]));
+  cJSON *modifiers_json = cJSON_AddArrayToObject(legend, "tokenModifiers");
+  cJSON_AddItemToArray(modifiers_json, cJSON_CreateString("declaration"));
+  return legend;
+}
+
+// Returns semantic token type of a token which is not an identifier, or -1.
+static int semantic_type(int kind) {
+  switch(kind) {
+    case _INT_NUMBER:
+    case _UINT_NUMBER:
+      return SEMANTIC_NUMBER;
+    case _IF:
+    case _ELSE:
+    case _RETURN:
+      return SEMANTIC_KEYWORD;
+    case _TYPE:
+      return SEMANTIC_TYPE;
+    case _AROP:
+    case _RELOP:
+    case _ASSIGN:
+      return SEMANTIC_OPERATOR;
+    default:
+      return -1;
+  }
+}
+
+static int is_before(int line, int column, POSITION position) {
+  return line < position.line || (line == position.line && column < position.character);
+}
+
+// Returns number of tokens which begin before `position`.
+static size_t tokens_before_position(const TOKEN *tokens, size_t tokens_num, POSITION position) {
+  size_t low = 0, high = tokens_num;
+  while(low < high) {
+    size_t middle = low + (high - low) / 2;
+    if(is_before(tokens[middle].line, tokens[middle].column, position))
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+int* semantic_tokens(const SNAPSHOT *snapshot, const TOKEN *tokens, size_t tokens_num,
+    POSITION start, POSITION end, size_t *data_num) {
+  size_t first = tokens_before_position(tokens, tokens_num, start);
+  size_t last = tokens_before_position(tokens, tokens_num, end);
+  if(last < first)
+    last = first;
+  int *data = malloc(((last - first) * 5 + 1) * sizeof(int));
+  if(data == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+
+  // Occurrences are sorted by position as the tokens, so both are walked together
+  int occurrence = 0;
+  int high = snapshot->occurrences_num;
+  while(occurrence < high) {
+    int middle = occurrence + (high - occurrence) / 2;
+    const SYMBOL_RANGE *range = &snapshot->occurrences[middle].range;
+    if(is_before(range->first_line, range->first_column, start))
+      occurrence = middle + 1;
+    else
+      high = middle;
+  }
+
+  size_t num = 0;
+  int line = 0, column = 0;
+  for(size_t i = first; i < last; i++) {
+    const TOKEN *token = &tokens[i];
+    int type = semantic_type(token->kind);
+    int modifiers = 0;
+    if(token->kind == _ID) {
+      POSITION position = { token->line, token->column };
+      while(occurrence < snapshot->occurrences_num
+            && is_before(snapshot->occurrences[occurrence].range.first_line,
+                         snapshot->occurrences[occurrence].range.first_column, position))
+        ++occurrence;
+      if(occurrence == snapshot->occurrences_num)
+        continue;
+      const SNAPSHOT_OCCURRENCE *resolved = &snapshot->occurrences[occurrence];
+      if(resolved->range.first_line != token->line || resolved->range.first_column != token->column)
+        continue;
+      unsigned kind = snapshot->symbols[resolved->symbol].entry.kind;
+      type = kind == FUN ? SEMANTIC_FUNCTION : kind == PAR ? SEMANTIC_PARAMETER : SEMANTIC_VARIABLE;
+      if(is_definition(snapshot, resolved))
+        modifiers = SEMANTIC_DECLARATION;
+    }
+    if(type == -1)
+      continue;
+
+    data[num++] = token->line - line;
+    data[num++] = token->line == line ? token->column - column : token->column;
+    data[num++] = token->length;
+    data[num++] = type;
+    data[num++] = modifiers;
+    line = token->line;
+    column = token->column;
+  }
+  *data_num = num;
+  return data;
+}
+
+cJSON* semantic_tokens_json(const int *data, size_t data_num) {
+  // Integers are not negative, and have at most 10 digits
+  char *json = malloc(data_num * 11 + 3);
+  if(json == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  size_t length = 0;
+  json[length++] = '[';
+  for(size_t i = 0; i < data_num; i++) {
+    if(i > 0)
+      json[length++] = ',';
+    char digits[10];
+    int digits_num = 0;
+    unsigned value = data[i];
+    do {
+      digits[digits_num++] = '0' + value % 10;
+      value /= 10;
+    } while(value > 0);
+    while(digits_num > 0)
+      json[length++] = digits[--digits_num];
+  }
+  json[length++] = ']';
+  json[length] = '\0';
+  cJSON *array = cJSON_CreateRaw(json);
+  free(json);
+  return array;
+}
+
+cJSON* semantic_tokens_edits(const int *old_data, size_t old_num,
+    const int *data, size_t data_num) {
+  size_t prefix = 0;
+  while(prefix < old_num && prefix < data_num && old_data[prefix] == data[prefix])
+    ++prefix;
+  size_t suffix = 0;
+  while(suffix < old_num - prefix && suffix < data_num - prefix
+        && old_data[old_num - suffix - 1] == data[data_num - suffix - 1])
+    ++suffix;
+
+  cJSON *edits = cJSON_CreateArray();
+  if(prefix + suffix == old_num && prefix + suffix == data_num)
+    return edits;
+  cJSON *edit = cJSON_CreateObject();
+  cJSON_AddNumberToObject(edit, "start", prefix);
+  cJSON_AddNumberToObject(edit, "deleteCount", old_num - prefix - suffix);
+  cJSON_AddItemToObject(edit, "data",
+      semantic_tokens_json(data + prefix, data_num - prefix - suffix));
+  cJSON_AddItemToArray(edits, edit);
+  return edits;
+}
@@ -1,29 +1,147 @@
 #ifndef MINIC_H
 #define MINIC_H
 
+#include <stddef.h>
+#include <stdatomic.h>
 #include <cjson/cJSON.h>
+#include "snapshot.h"
+#include "tokens.h"
+#include "analysis.h"
+
+// Maximum number of completion items in a response
+#define COMPLETION_LIMIT 50
+
+// LSP completion item kinds
+#define COMPLETION_FUNCTION 3
+#define COMPLETION_VARIABLE 6
+
+// LSP document highlight kinds
+#define HIGHLIGHT_READ 2
+#define HIGHLIGHT_WRITE 3
+
+// LSP semantic token types, in the order of the legend
+enum semantic_token_type {
+  SEMANTIC_FUNCTION,
+  SEMANTIC_PARAMETER,
+  SEMANTIC_VARIABLE,
+  SEMANTIC_NUMBER,
+  SEMANTIC_KEYWORD,
+  SEMANTIC_TYPE,
+  SEMANTIC_OPERATOR
+};
+
+// LSP semantic token modifiers, as bits of the legend
+#define SEMANTIC_DECLARATION 1
 
 /*
- * Parse the `text` string and fill `diagnostics`.
+ * Parse the first `length` characters of `text` and fill `diagnostics`.
  *
  * If `diagnostics` is NULL, only parsing is done
- * (useful to fill symtab without reporting diagnostics).
+ * (useful to build a snapshot without reporting diagnostics).
+ *
+ * If `cancelled` is not NULL, parsing stops early once it becomes non-zero,
+ * and the results are incomplete.
+ *
+ * Returns a snapshot of all symbols defined in the text.
+ * WARNING: Caller is responsible to free the result.
+ */
+SNAPSHOT* parse(cJSON *diagnostics, const char *text, size_t length,
+    const atomic_int *cancelled);
+
+/*
+ * Same as `parse`, but consumes already lexed `tokens` of `text`.
+ *
+ * If `cache` is not NULL, functions found in `*cache` are not checked again,
+ * and `*cache` is replaced with results of all functions of the text
+ * (`*cache` may be NULL the first time).
+ */
+SNAPSHOT* parse_tokens(cJSON *diagnostics, const char *text, const TOKEN *tokens,
+    size_t tokens_num, ANALYSIS_CACHE **cache, const atomic_int *cancelled);
+
+/*
+ * Converts a symbol range to LSP range object.
+ */
+cJSON* range_json(SYMBOL_RANGE sym_range);
+
+/*
+ * Return info about the snapshot symbol at `index`.
+ * Returns NULL if `index` is -1.
+ */
+cJSON* symbol_info(const SNAPSHOT *snapshot, int index);
+
+/*
+ * Return definition location of the snapshot symbol at `index`.
+ * Returns NULL if `index` is -1.
+ */
+cJSON* symbol_location(const SNAPSHOT *snapshot, int index);
+
+/*
+ * Return locations of all occurrences of the snapshot symbol at `index`
+ * in the document with `uri`, optionally without its definition.
+ */
+cJSON* symbol_references(const SNAPSHOT *snapshot, int index, const char *uri,
+    int include_declaration);
+
+/*
+ * Return document highlights of all occurrences of the snapshot symbol at `index`.
+ */
+cJSON* symbol_highlights(const SNAPSHOT *snapshot, int index);
+
+/*
+ * Return workspace edit which renames all occurrences of the snapshot symbol
+ * at `index` in the document with `uri` to `new_name`.
+ * Returns NULL if `index` is -1.
+ */
+cJSON* symbol_rename(const SNAPSHOT *snapshot, int index, const char *uri,
+    const char *new_name);
+
+/*
+ * Checks if `name` can be used as an identifier.
  */
-void parse(cJSON *diagnostics, const char *text);
+int valid_identifier(const char *name);
 
 /*
- * Parse the `text` string and return info about the specified symbol.
+ * Return the best completions for the specified name part visible at `position`,
+ * as a completion list. The list is incomplete if there are more than
+ * COMPLETION_LIMIT completions. Items are without detail.
+ */
+cJSON* symbol_completion(const SNAPSHOT *snapshot, const char *symbol_name_part,
+    POSITION position);
+
+/*
+ * Adds detail to a completion item returned by `symbol_completion`.
+ */
+void symbol_resolve(cJSON *item);
+
+/*
+ * Returns legend of the semantic token types and modifiers.
+ */
+cJSON* semantic_tokens_legend(void);
+
+/*
+ * Encodes `tokens` of a text which begin between `start` and `end` positions
+ * as LSP semantic tokens: 5 integers per token, relative to the previous one.
+ * Identifiers are classified by the snapshot symbols they resolve to,
+ * and left out if they are not resolved.
+ * Stores number of the integers to `data_num`.
+ *
+ * WARNING: Caller is responsible to free the result.
  */
-cJSON* symbol_info(const char *symbol_name, const char *text);
+int* semantic_tokens(const SNAPSHOT *snapshot, const TOKEN *tokens, size_t tokens_num,
+    POSITION start, POSITION end, size_t *data_num);
 
 /*
- * Parse the `text` string and return definition location of the specified symbol.
+ * Converts encoded semantic tokens to a JSON array,
+ * preformatted instead of an item per integer.
  */
-cJSON* symbol_location(const char *symbol_name, const char *text);
+cJSON* semantic_tokens_json(const int *data, size_t data_num);
 
 /*
- * Parse the `text` string and return all completions for the specified name part.
+ * Returns semantic tokens edits which turn `old_data` into `data`.
+ * Encoded tokens only change around edits of the text,
+ * so a single edit replaces everything between the common prefix and suffix.
  */
-cJSON* symbol_completion(const char *symbol_name_part, const char *text);
+cJSON* semantic_tokens_edits(const int *old_data, size_t old_num,
+    const int *data, size_t data_num);
 
 #endif /* end of include guard: MINIC_H */
@@ -1,16 +1,26 @@
+%code requires {
+  #include "context.h"
+}
+
 %{
   #include <stdio.h>
   #include "defs.h"
   #include "symtab.h"
+%}
 
-  extern int yylineno;
-  int yylex(void);
-  int yyerror(const char *text);
+%code {
+  int yylex(YYSTYPE *yylval, YYLTYPE *yylloc, PARSE_CONTEXT *ctx);
+  int yyerror(YYLTYPE *yylloc, PARSE_CONTEXT *ctx, const char *text);
+}
 
-  int var_num = 0;
-  int fun_idx = -1;
-  int fcall_idx = -1;
-%}
+%define api.pure full
+%locations
+%param {PARSE_CONTEXT *ctx}
+
+%initial-action {
+  @$.first_line = @$.last_line = 0;
+  @$.first_column = @$.last_column = 0;
+}
 
 %union {
   int i;
@@ -41,16 +51,10 @@
 
 %%
 
+/* Functions are parsed one at a time (see `parse_tokens`),
+   which also checks for 'main' after the last one */
 program
   : function_list
-      {
-        int idx = lookup_symbol("main", FUN);
-        if(idx == -1)
-          err("undefined reference to 'main'");
-        else
-          if(get_type(idx) != INT)
-            warn("return type of 'main' is not int");
-      }
   ;
 
 function_list
@@ -61,18 +65,21 @@ function_list
 function
   : type _ID
       {
-        fun_idx = lookup_symbol($2, FUN);
-        if(fun_idx == -1) {
+        ctx->fun_idx = lookup_symbol(&ctx->symtab, $2, FUN);
+        if(ctx->fun_idx == -1) {
           SYMBOL_RANGE range = RANGE(@2);
-          fun_idx = insert_symbol($2, FUN, $1, NO_ATR, NO_ATR, range);
+          ctx->fun_idx = insert_symbol(&ctx->symtab, $2, FUN, $1, NO_ATR, NO_ATR, range);
         }
         else
           err("redefinition of function '%s'", $2);
+        snapshot_record_occurrence(ctx->snapshot, ctx->fun_idx, (SYMBOL_RANGE) RANGE(@2), WRITE_ACCESS);
       }
     _LPAREN parameter _RPAREN body
       {
-        clear_symbols(fun_idx + 1);
-        var_num = 0;
+        POSITION scope_end = { @7.last_line, @7.last_column };
+        snapshot_record(ctx->snapshot, &ctx->symtab, ctx->fun_idx + 1, scope_end);
+        clear_symbols(&ctx->symtab, ctx->fun_idx + 1);
+        ctx->var_num = 0;
       }
   ;
 
@@ -83,14 +90,15 @@ type
 
 parameter
   : /* empty */
-      { set_atr1(fun_idx, 0); }
+      { set_atr1(&ctx->symtab, ctx->fun_idx, 0); }
 
   | type _ID
       {
         SYMBOL_RANGE range = RANGE(@2);
-        insert_symbol($2, PAR, $1, 1, NO_ATR, range);
-        set_atr1(fun_idx, 1);
-        set_atr2(fun_idx, $1);
+        int idx = insert_symbol(&ctx->symtab, $2, PAR, $1, 1, NO_ATR, range);
+        snapshot_record_occurrence(ctx->snapshot, idx, range, WRITE_ACCESS);
+        set_atr1(&ctx->symtab, ctx->fun_idx, 1);
+        set_atr2(&ctx->symtab, ctx->fun_idx, $1);
       }
   ;
 
@@ -106,9 +114,10 @@ variable_list
 variable
   : type _ID _SEMICOLON
       {
-        if(lookup_symbol($2, VAR|PAR) == -1) {
+        if(lookup_symbol(&ctx->symtab, $2, VAR|PAR) == -1) {
           SYMBOL_RANGE range = RANGE(@2);
-          insert_symbol($2, VAR, $1, ++var_num, NO_ATR, range);
+          int idx = insert_symbol(&ctx->symtab, $2, VAR, $1, ++ctx->var_num, NO_ATR, range);
+          snapshot_record_occurrence(ctx->snapshot, idx, range, WRITE_ACCESS);
         }
         else
            err("redefinition of '%s'", $2);
@@ -134,11 +143,12 @@ compound_statement
 assignment_statement
   : _ID _ASSIGN num_exp _SEMICOLON
       {
-        int idx = lookup_symbol($1, VAR|PAR);
+        int idx = lookup_symbol(&ctx->symtab, $1, VAR|PAR);
+        snapshot_record_occurrence(ctx->snapshot, idx, (SYMBOL_RANGE) RANGE(@1), WRITE_ACCESS);
         if(idx == -1)
           err("invalid lvalue '%s' in assignment", $1);
         else
-          if(get_type(idx) != get_type($3))
+          if(get_type(&ctx->symtab, idx) != get_type(&ctx->symtab, $3))
             err("incompatible types in assignment");
       }
   ;
@@ -147,7 +157,7 @@ num_exp
   : exp
   | num_exp _AROP exp
       {
-        if(get_type($1) != get_type($3))
+        if(get_type(&ctx->symtab, $1) != get_type(&ctx->symtab, $3))
           err("invalid operands: arithmetic operation");
       }
   ;
@@ -156,7 +166,8 @@ exp
   : literal
   | _ID
       {
-        $$ = lookup_symbol($1, VAR|PAR);
+        $$ = lookup_symbol(&ctx->symtab, $1, VAR|PAR);
+        snapshot_record_occurrence(ctx->snapshot, $$, (SYMBOL_RANGE) RANGE(@1), READ_ACCESS);
         if($$ == -1)
           err("'%s' undeclared", $1);
       }
@@ -167,25 +178,42 @@ exp
 
 literal
   : _INT_NUMBER
-      { $$ = insert_literal($1, INT); }
+      {
+        // Range is checked once, when the literal is inserted
+        $$ = lookup_literal(&ctx->symtab, $1, INT);
+        if($$ == -1) {
+          if(!literal_in_range($1, INT))
+            err("literal out of range");
+          $$ = insert_literal(&ctx->symtab, $1, INT);
+        }
+      }
 
   | _UINT_NUMBER
-      { $$ = insert_literal($1, UINT); }
+      {
+        // Range is checked once, when the literal is inserted
+        $$ = lookup_literal(&ctx->symtab, $1, UINT);
+        if($$ == -1) {
+          if(!literal_in_range($1, UINT))
+            err("literal out of range");
+          $$ = insert_literal(&ctx->symtab, $1, UINT);
+        }
+      }
   ;
 
 function_call
   : _ID
       {
-        fcall_idx = lookup_symbol($1, FUN);
-        if(fcall_idx == -1)
+        ctx->fcall_idx = lookup_symbol(&ctx->symtab, $1, FUN);
+        snapshot_record_occurrence(ctx->snapshot, ctx->fcall_idx, (SYMBOL_RANGE) RANGE(@1), READ_ACCESS);
+        if(ctx->fcall_idx == -1)
           err("'%s' is not a function", $1);
       }
     _LPAREN argument _RPAREN
       {
-        if(get_atr1(fcall_idx) != (unsigned int) $4)
+        if(get_atr1(&ctx->symtab, ctx->fcall_idx) != (unsigned int) $4)
           err("wrong number of args to function '%s'",
-              get_name(fcall_idx));
-        set_type(FUN_REG, get_type(fcall_idx));
+              get_name(&ctx->symtab, ctx->fcall_idx));
+        set_type(&ctx->symtab, FUN_REG, get_type(&ctx->symtab, ctx->fcall_idx));
         $$ = FUN_REG;
       }
   ;
@@ -196,9 +224,9 @@ argument
 
   | num_exp
     {
-      if(get_atr2(fcall_idx) != get_type($1))
+      if(get_atr2(&ctx->symtab, ctx->fcall_idx) != get_type(&ctx->symtab, $1))
         err("incompatible type for argument in '%s'",
-            get_name(fcall_idx));
+            get_name(&ctx->symtab, ctx->fcall_idx));
       $$ = 1;
     }
   ;
@@ -215,7 +243,7 @@ if_part
 rel_exp
   : num_exp _RELOP num_exp
       {
-        if(get_type($1) != get_type($3))
+        if(get_type(&ctx->symtab, $1) != get_type(&ctx->symtab, $3))
           err("invalid operands: relational operator");
       }
   ;
@@ -223,7 +251,7 @@ rel_exp
 return_statement
   : _RETURN num_exp _SEMICOLON
       {
-        if(get_type(fun_idx) != get_type($2))
+        if(get_type(&ctx->symtab, ctx->fun_idx) != get_type(&ctx->symtab, $2))
           err("incompatible types in return");
       }
   ;
@@ -0,0 +1,353 @@
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "err_codes.h"
+#include "snapshot.h"
+
+SNAPSHOT* snapshot_create(void) {
+  SNAPSHOT *snapshot = calloc(1, sizeof(SNAPSHOT));
+  if(snapshot == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  return snapshot;
+}
+
+void snapshot_free(SNAPSHOT *snapshot) {
+  if(snapshot == NULL)
+    return;
+  free(snapshot->symbols);
+  free(snapshot->occurrences);
+  free(snapshot->references);
+  free(snapshot->references_start);
+  free(snapshot->pending);
+  arena_free(snapshot->arena);
+  free(snapshot);
+}
+
+// Grows `array` to hold at least one more element.
+static void* grow(void *array, int *capacity, int num, size_t element_size) {
+  if(num < *capacity)
+    return array;
+  *capacity = *capacity ? *capacity * 2 : 32;
+  array = realloc(array, *capacity * element_size);
+  if(array == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  return array;
+}
+
+void snapshot_record(SNAPSHOT *snapshot, SYMTAB *symtab, int begin_index,
+    POSITION scope_end) {
+  int last_index = get_last_element(symtab);
+  if(last_index < begin_index)
+    return;
+  // Snapshot index of each recorded element, or -1
+  int *recorded = malloc((last_index - begin_index + 1) * sizeof(int));
+  if(recorded == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+
+  for(int i = begin_index; i <= last_index; i++) {
+    recorded[i - begin_index] = -1;
+    if(!(get_kind(symtab, i) & (FUN|VAR|PAR)))
+      continue;
+
+    snapshot->symbols = grow(snapshot->symbols, &snapshot->symbols_capacity,
+        snapshot->symbols_num, sizeof(SNAPSHOT_SYMBOL));
+    recorded[i - begin_index] = snapshot->symbols_num;
+    SNAPSHOT_SYMBOL *symbol = &snapshot->symbols[snapshot->symbols_num++];
+    symbol->entry.name = get_name(symtab, i);
+    symbol->entry.kind = get_kind(symtab, i);
+    symbol->entry.type = get_type(symtab, i);
+    symbol->entry.atr1 = get_atr1(symtab, i);
+    symbol->entry.atr2 = get_atr2(symtab, i);
+    symbol->entry.range = get_range(symtab, i);
+    SYMBOL_RANGE scope = {
+      symbol->entry.range.first_line, symbol->entry.range.first_column,
+      scope_end.line, scope_end.character
+    };
+    symbol->scope = scope;
+  }
+
+  // Occurrences of the recorded elements are resolved, the rest stay pending
+  int pending_num = 0;
+  for(int i = 0; i < snapshot->pending_num; i++) {
+    SNAPSHOT_OCCURRENCE occurrence = snapshot->pending[i];
+    if(occurrence.symbol < begin_index) {
+      snapshot->pending[pending_num++] = occurrence;
+      continue;
+    }
+    occurrence.symbol = recorded[occurrence.symbol - begin_index];
+    if(occurrence.symbol == -1)
+      continue;
+    snapshot->occurrences = grow(snapshot->occurrences, &snapshot->occurrences_capacity,
+        snapshot->occurrences_num, sizeof(SNAPSHOT_OCCURRENCE));
+    snapshot->occurrences[snapshot->occurrences_num++] = occurrence;
+  }
+  snapshot->pending_num = pending_num;
+  free(recorded);
+}
+
+void snapshot_record_occurrence(SNAPSHOT *snapshot, int index, SYMBOL_RANGE range,
+    enum occurrence_access access) {
+  if(index < 0)
+    return;
+  snapshot->pending = grow(snapshot->pending, &snapshot->pending_capacity,
+      snapshot->pending_num, sizeof(SNAPSHOT_OCCURRENCE));
+  SNAPSHOT_OCCURRENCE *occurrence = &snapshot->pending[snapshot->pending_num++];
+  occurrence->range = range;
+  occurrence->symbol = index;
+  occurrence->access = access;
+}
+
+static SYMBOL_RANGE move_range(SYMBOL_RANGE range, int lines) {
+  range.first_line += lines;
+  range.last_line += lines;
+  return range;
+}
+
+void snapshot_append(SNAPSHOT *snapshot, const SNAPSHOT *source, int symbols_begin,
+    int occurrences_begin, int pending_begin, int lines) {
+  int symbols_base = snapshot->symbols_num;
+  for(int i = symbols_begin; i < source->symbols_num; i++) {
+    snapshot->symbols = grow(snapshot->symbols, &snapshot->symbols_capacity,
+        snapshot->symbols_num, sizeof(SNAPSHOT_SYMBOL));
+    SNAPSHOT_SYMBOL *symbol = &snapshot->symbols[snapshot->symbols_num++];
+    *symbol = source->symbols[i];
+    symbol->entry.name = arena_intern(snapshot->arena, symbol->entry.name,
+        strlen(symbol->entry.name));
+    symbol->entry.range = move_range(symbol->entry.range, lines);
+    symbol->scope = move_range(symbol->scope, lines);
+  }
+  for(int i = occurrences_begin; i < source->occurrences_num; i++) {
+    snapshot->occurrences = grow(snapshot->occurrences, &snapshot->occurrences_capacity,
+        snapshot->occurrences_num, sizeof(SNAPSHOT_OCCURRENCE));
+    SNAPSHOT_OCCURRENCE *occurrence = &snapshot->occurrences[snapshot->occurrences_num++];
+    *occurrence = source->occurrences[i];
+    occurrence->symbol += symbols_base - symbols_begin;
+    occurrence->range = move_range(occurrence->range, lines);
+  }
+  for(int i = pending_begin; i < source->pending_num; i++) {
+    snapshot->pending = grow(snapshot->pending, &snapshot->pending_capacity,
+        snapshot->pending_num, sizeof(SNAPSHOT_OCCURRENCE));
+    SNAPSHOT_OCCURRENCE *occurrence = &snapshot->pending[snapshot->pending_num++];
+    *occurrence = source->pending[i];
+    occurrence->range = move_range(occurrence->range, lines);
+  }
+}
+
+// Checks if `position` lies inside of the `range` (inclusive).
+static int in_range(SYMBOL_RANGE range, POSITION position) {
+  if(position.line < range.first_line
+     || (position.line == range.first_line && position.character < range.first_column))
+    return 0;
+  if(position.line > range.last_line
+     || (position.line == range.last_line && position.character > range.last_column))
+    return 0;
+  return 1;
+}
+
+// Checks if symbol `a` is defined before symbol `b`.
+static int defined_before(const SNAPSHOT_SYMBOL *a, const SNAPSHOT_SYMBOL *b) {
+  return a->scope.first_line < b->scope.first_line
+    || (a->scope.first_line == b->scope.first_line
+        && a->scope.first_column < b->scope.first_column);
+}
+
+static int compare_names(const void *a, const void *b) {
+  const SNAPSHOT_SYMBOL *symbol_a = a;
+  const SNAPSHOT_SYMBOL *symbol_b = b;
+  return strcmp(symbol_a->entry.name, symbol_b->entry.name);
+}
+
+static int compare_occurrences(const void *a, const void *b) {
+  const SYMBOL_RANGE *range_a = &((const SNAPSHOT_OCCURRENCE*) a)->range;
+  const SYMBOL_RANGE *range_b = &((const SNAPSHOT_OCCURRENCE*) b)->range;
+  if(range_a->first_line != range_b->first_line)
+    return range_a->first_line < range_b->first_line ? -1 : 1;
+  if(range_a->first_column != range_b->first_column)
+    return range_a->first_column < range_b->first_column ? -1 : 1;
+  return 0;
+}
+
+void snapshot_index(SNAPSHOT *snapshot) {
+  for(int i = 0; i < snapshot->symbols_num; i++)
+    snapshot->symbols[i].order = i;
+  // Empty arrays may be NULL, which qsort doesn't accept
+  if(snapshot->symbols_num > 1)
+    qsort(snapshot->symbols, snapshot->symbols_num, sizeof(SNAPSHOT_SYMBOL), compare_names);
+
+  // Occurrences refer to the symbols by their old indices
+  int *new_index = malloc((snapshot->symbols_num + 1) * sizeof(int));
+  if(new_index == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  for(int i = 0; i < snapshot->symbols_num; i++)
+    new_index[snapshot->symbols[i].order] = i;
+  for(int i = 0; i < snapshot->occurrences_num; i++)
+    snapshot->occurrences[i].symbol = new_index[snapshot->occurrences[i].symbol];
+  if(snapshot->occurrences_num > 1)
+    qsort(snapshot->occurrences, snapshot->occurrences_num, sizeof(SNAPSHOT_OCCURRENCE),
+        compare_occurrences);
+
+  // Counting sort by symbol keeps occurrences of each symbol in text order
+  snapshot->references = malloc((snapshot->occurrences_num + 1) * sizeof(int));
+  snapshot->references_start = calloc(snapshot->symbols_num + 1, sizeof(int));
+  if(snapshot->references == NULL || snapshot->references_start == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  for(int i = 0; i < snapshot->occurrences_num; i++)
+    ++snapshot->references_start[snapshot->occurrences[i].symbol + 1];
+  for(int i = 0; i < snapshot->symbols_num; i++)
+    snapshot->references_start[i + 1] += snapshot->references_start[i];
+  int *next = new_index; // Reused, as the next free slot of each symbol
+  memcpy(next, snapshot->references_start, snapshot->symbols_num * sizeof(int));
+  for(int i = 0; i < snapshot->occurrences_num; i++)
+    snapshot->references[next[snapshot->occurrences[i].symbol]++] = i;
+  free(new_index);
+
+  free(snapshot->pending);
+  snapshot->pending = NULL;
+  snapshot->pending_num = 0;
+  snapshot->pending_capacity = 0;
+}
+
+int snapshot_symbol_at(const SNAPSHOT *snapshot, POSITION position) {
+  // Last occurrence which begins at or before `position`
+  int low = 0;
+  int high = snapshot->occurrences_num;
+  while(low < high) {
+    int middle = low + (high - low) / 2;
+    const SYMBOL_RANGE *range = &snapshot->occurrences[middle].range;
+    if(range->first_line < position.line
+       || (range->first_line == position.line && range->first_column <= position.character))
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if(low == 0 || !in_range(snapshot->occurrences[low - 1].range, position))
+    return -1;
+  return snapshot->occurrences[low - 1].symbol;
+}
+
+// Returns index of the first symbol which name is not less than the first
+// `length` characters of `name` (compared as a prefix if `length` is less).
+static int lower_bound(const SNAPSHOT *snapshot, const char *name, size_t length) {
+  int low = 0;
+  int high = snapshot->symbols_num;
+  while(low < high) {
+    int middle = low + (high - low) / 2;
+    if(strncmp(snapshot->symbols[middle].entry.name, name, length) < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+int snapshot_lookup(const SNAPSHOT *snapshot, const char *name, unsigned kind,
+    POSITION position) {
+  int found = -1;
+  size_t length = strlen(name) + 1; // Including the terminator, for an exact match
+  for(int i = lower_bound(snapshot, name, length);
+      i < snapshot->symbols_num && strcmp(snapshot->symbols[i].entry.name, name) == 0; i++) {
+    const SNAPSHOT_SYMBOL *symbol = &snapshot->symbols[i];
+    if(symbol->entry.kind & kind
+       && in_range(symbol->scope, position)
+       && (found == -1 || defined_before(&snapshot->symbols[found], symbol)))
+      found = i;
+  }
+  return found;
+}
+
+// Returns number of characters skipped between the first and the last
+// character of `name_part` found in `name`, or -1 if it isn't a subsequence.
+static int subsequence_gaps(const char *name, const char *name_part) {
+  const char *first = NULL;
+  int matched = 0;
+  for(; *name != '\0' && name_part[matched] != '\0'; name++) {
+    if(tolower((unsigned char) *name) == tolower((unsigned char) name_part[matched])) {
+      if(first == NULL)
+        first = name;
+      ++matched;
+    }
+  }
+  if(name_part[matched] != '\0')
+    return -1;
+  return first == NULL ? 0 : (int) (name - first) - matched;
+}
+
+// Returns score of a symbol matched with `gaps` skipped characters.
+static int match_score(const SNAPSHOT_SYMBOL *symbol, int prefix, int gaps) {
+  int score = 0;
+  if(!prefix)
+    score += (1 + (gaps < 255 ? gaps : 255)) << 8;
+  if(symbol->scope.last_line == INT_MAX) // Global
+    score += 1 << 4;
+  if(symbol->entry.kind == PAR)
+    score += 1;
+  else if(symbol->entry.kind == FUN)
+    score += 2;
+  return score;
+}
+
+static int compare_matches(const void *a, const void *b) {
+  const SNAPSHOT_MATCH *match_a = a;
+  const SNAPSHOT_MATCH *match_b = b;
+  if(match_a->score != match_b->score)
+    return match_a->score < match_b->score ? -1 : 1;
+  return match_a->index - match_b->index; // Symbols are sorted by name
+}
+
+// Adds a match of the symbol at `index`, unless a symbol with the same name is found.
+// Returns the new number of results.
+static int add_match(const SNAPSHOT *snapshot, SNAPSHOT_MATCH *results, int found_num,
+    int index, int prefix, int gaps) {
+  const SNAPSHOT_SYMBOL *symbol = &snapshot->symbols[index];
+  // Symbols with the same name are adjacent, the innermost one is kept
+  if(found_num > 0) {
+    SNAPSHOT_MATCH *last = &results[found_num - 1];
+    const SNAPSHOT_SYMBOL *last_symbol = &snapshot->symbols[last->index];
+    if(strcmp(last_symbol->entry.name, symbol->entry.name) == 0) {
+      if(defined_before(last_symbol, symbol)) {
+        last->index = index;
+        last->score = match_score(symbol, prefix, gaps);
+      }
+      return found_num;
+    }
+  }
+  results[found_num].index = index;
+  results[found_num].score = match_score(symbol, prefix, gaps);
+  return found_num + 1;
+}
+
+int snapshot_complete(const SNAPSHOT *snapshot, SNAPSHOT_MATCH *results,
+    const char *name_part, POSITION position, int limit) {
+  int found_num = 0;
+  size_t name_part_length = strlen(name_part);
+  int prefix_begin = lower_bound(snapshot, name_part, name_part_length);
+  int prefix_end = prefix_begin;
+  while(prefix_end < snapshot->symbols_num
+        && strncmp(snapshot->symbols[prefix_end].entry.name, name_part, name_part_length) == 0)
+    ++prefix_end;
+
+  for(int i = prefix_begin; i < prefix_end; i++) {
+    if(in_range(snapshot->symbols[i].scope, position))
+      found_num = add_match(snapshot, results, found_num, i, 1, 0);
+  }
+
+  // Subsequences are searched only while there are too few prefixes,
+  // and the search stops once it is known that some matches are left out
+  for(int i = 0; i < snapshot->symbols_num && found_num <= limit; i++) {
+    if(i == prefix_begin)
+      i = prefix_end;
+    if(i == snapshot->symbols_num)
+      break;
+    const SNAPSHOT_SYMBOL *symbol = &snapshot->symbols[i];
+    if(!in_range(symbol->scope, position))
+      continue;
+    int gaps = subsequence_gaps(symbol->entry.name, name_part);
+    if(gaps != -1)
+      found_num = add_match(snapshot, results, found_num, i, 0, gaps);
+  }
+
+  qsort(results, found_num, sizeof(SNAPSHOT_MATCH), compare_matches);
+  return found_num;
+}
@@ -0,0 +1,129 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "io.h"
+#include "arena.h"
+#include "symtab.h"
+
+// Symbol recorded in a snapshot
+typedef struct {
+  SYMBOL_ENTRY entry;     // Symbol table element
+  SYMBOL_RANGE scope;     // Text range in which the symbol is visible
+  int order;              // Index of the symbol before it was indexed
+} SNAPSHOT_SYMBOL;
+
+// How an occurrence accesses its symbol
+enum occurrence_access { READ_ACCESS, WRITE_ACCESS };
+
+// Definition or use of a symbol
+typedef struct {
+  SYMBOL_RANGE range;     // Text range of the identifier
+  int symbol;             // Index of the symbol (symbol table index until resolved)
+  enum occurrence_access access;  // Definitions and assignments write
+} SNAPSHOT_OCCURRENCE;
+
+/*
+ * Result of a document analysis: every function, parameter and variable
+ * defined in the document, with the range of text where it is in scope,
+ * and every occurrence of their names resolved to them.
+ * Once indexed, symbols are sorted by name, and occurrences by position.
+ */
+typedef struct snapshot {
+  int version;            // Document version the snapshot was made from
+  SNAPSHOT_SYMBOL *symbols;
+  int symbols_num;
+  int symbols_capacity;
+  SNAPSHOT_OCCURRENCE *occurrences;
+  int occurrences_num;
+  int occurrences_capacity;
+  // Occurrence indices grouped by symbol: occurrences of symbol `i` are
+  // `references[references_start[i]]` up to `references[references_start[i + 1]]`
+  int *references;
+  int *references_start;
+  SNAPSHOT_OCCURRENCE *pending;  // Occurrences of symbols which are not recorded yet
+  int pending_num;
+  int pending_capacity;
+  ARENA *arena;           // Owns names of the symbols
+} SNAPSHOT;
+
+/*
+ * Creates an empty snapshot.
+ */
+SNAPSHOT* snapshot_create(void);
+
+/*
+ * Frees a snapshot and all of its symbols, with the arena of their names.
+ */
+void snapshot_free(SNAPSHOT *snapshot);
+
+/*
+ * Records `symtab` elements from `begin_index` to the last element,
+ * which go out of scope at `scope_end` position.
+ * Only functions, parameters and variables are recorded.
+ * Names are not copied: they must be owned by the snapshot's arena.
+ */
+void snapshot_record(SNAPSHOT *snapshot, SYMTAB *symtab, int begin_index,
+    POSITION scope_end);
+
+/*
+ * Records an occurrence of `symtab` element at `index` at text `range`.
+ * It is resolved to a snapshot symbol when the element is recorded.
+ */
+void snapshot_record_occurrence(SNAPSHOT *snapshot, int index, SYMBOL_RANGE range,
+    enum occurrence_access access);
+
+/*
+ * Appends symbols and occurrences of `source`, beginning with the specified
+ * indices, to a snapshot which is not indexed yet, moving them by `lines`.
+ * Resolved occurrences are appended after the symbols they refer to,
+ * and names are interned in the snapshot's arena.
+ */
+void snapshot_append(SNAPSHOT *snapshot, const SNAPSHOT *source, int symbols_begin,
+    int occurrences_begin, int pending_begin, int lines);
+
+// Completion candidate
+typedef struct {
+  int index;              // Index of the symbol
+  int score;              // Lower score is a better match
+} SNAPSHOT_MATCH;
+
+/*
+ * Sorts symbols by name, so they can be searched by name and prefix,
+ * and occurrences by position, so they can be searched by position.
+ * Groups occurrences by symbol (see `references`).
+ * Must be called after the last `snapshot_record`.
+ */
+void snapshot_index(SNAPSHOT *snapshot);
+
+/*
+ * Returns index of the symbol which occurs at `position`.
+ * If there is no occurrence at `position`, returns -1.
+ */
+int snapshot_symbol_at(const SNAPSHOT *snapshot, POSITION position);
+
+/*
+ * Returns index of the innermost symbol with `name` and one of the `kind`s,
+ * which is visible at `position`.
+ * If the symbol is not found, returns -1.
+ */
+int snapshot_lookup(const SNAPSHOT *snapshot, const char *name, unsigned kind,
+    POSITION position);
+
+/*
+ * Searches for symbols visible at `position`, which names start with `name_part`,
+ * or contain its characters in order (case-insensitive).
+ * Only the innermost of the symbols with the same name is included.
+ * Matches are pushed to the `results` array, which must be large enough
+ * to hold all symbols of the snapshot, from the best to the worst:
+ * prefix before subsequence matches, tighter subsequences first,
+ * then local before global symbols, variables and parameters before functions.
+ *
+ * All prefix matches are found, but subsequences only while there are no more
+ * than `limit` matches, so more than `limit` results mean some are left out.
+ *
+ * Return value is number of symbols found.
+ */
+int snapshot_complete(const SNAPSHOT *snapshot, SNAPSHOT_MATCH *results,
+    const char *name_part, POSITION position, int limit);
+
+#endif /* end of include guard: SNAPSHOT_H */
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "err_codes.h"
+#include "stats.h"
+
+typedef struct {
+  atomic_ulong count;
+  atomic_ullong total;    // Nanoseconds
+  atomic_ullong max;
+  atomic_ulong buckets[STATS_BUCKETS];
+} HISTOGRAM;
+
+typedef struct {
+  HISTOGRAM latency;
+  atomic_ulong messages_in;
+  atomic_ullong bytes_in;
+  atomic_ulong messages_out;
+  atomic_ullong bytes_out;
+} METHOD_STATS;
+
+static const char *stage_names[STAGES_NUM] = {
+  "read", "decode", "dispatch", "lex", "parse", "lookup", "serialize", "write"
+};
+
+// Counters are updated by every thread, without locks
+HISTOGRAM stage_stats[STAGES_NUM];
+METHOD_STATS method_stats[STATS_METHODS_LENGTH];
+
+// Trace file, opened before any thread is started
+FILE *trace;
+
+long long stats_now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+void stats_open_trace(const char *path) {
+  trace = fopen(path, "a");
+  if(trace == NULL) {
+    perror(path);
+    exit(EXIT_IO_ERROR);
+  }
+  struct stat trace_stat, output_stat;
+  if(fstat(fileno(trace), &trace_stat) == 0 && fstat(STDOUT_FILENO, &output_stat) == 0
+     && trace_stat.st_dev == output_stat.st_dev && trace_stat.st_ino == output_stat.st_ino) {
+    fprintf(stderr, "%s: trace can't be written to the standard output\n", path);
+    exit(EXIT_IO_ERROR);
+  }
+  // Lines are complete even if the server is killed
+  setvbuf(trace, NULL, _IOLBF, 0);
+}
+
+static void histogram_add(HISTOGRAM *histogram, long long duration) {
+  if(duration < 0)
+    duration = 0;
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->total, duration, memory_order_relaxed);
+  unsigned long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+  while((unsigned long long) duration > max
+        && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, duration,
+            memory_order_relaxed, memory_order_relaxed))
+    ;
+
+  int bucket = 0;
+  for(long long microseconds = duration / 2000; microseconds > 0 && bucket < STATS_BUCKETS - 1;
+      microseconds >>= 1)
+    ++bucket;
+  atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+}
+
+void stats_stage(enum stats_stage stage, long long start) {
+  long long end = stats_now();
+  histogram_add(&stage_stats[stage], end - start);
+  if(trace != NULL)
+    fprintf(trace, "{\"time_ms\":%.3f,\"stage\":\"%s\",\"duration_us\":%.1f}\n",
+        end / 1e6, stage_names[stage], (end - start) / 1e3);
+}
+
+void stats_method(int method, const char *name, int id, long long start) {
+  long long end = stats_now();
+  histogram_add(&method_stats[method].latency, end - start);
+  if(trace != NULL)
+    fprintf(trace, "{\"time_ms\":%.3f,\"method\":\"%s\",\"id\":%d,\"duration_us\":%.1f}\n",
+        end / 1e6, name != NULL ? name : "(other)", id, (end - start) / 1e3);
+}
+
+void stats_bytes_in(int method, size_t bytes) {
+  atomic_fetch_add_explicit(&method_stats[method].messages_in, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&method_stats[method].bytes_in, bytes, memory_order_relaxed);
+}
+
+void stats_bytes_out(int method, size_t bytes) {
+  atomic_fetch_add_explicit(&method_stats[method].messages_out, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&method_stats[method].bytes_out, bytes, memory_order_relaxed);
+}
+
+// Returns upper bound of the `percent` percentile, in milliseconds.
+static double percentile(const unsigned long *buckets, unsigned long count,
+    unsigned long long max, int percent) {
+  unsigned long rank = (count * percent + 99) / 100;
+  unsigned long seen = 0;
+  for(int i = 0; i < STATS_BUCKETS; i++) {
+    seen += buckets[i];
+    if(seen >= rank && seen > 0) {
+      double bound = (double) (2ULL << i) / 1e3;
+      return bound < max / 1e6 ? bound : max / 1e6;
+    }
+  }
+  return max / 1e6;
+}
+
+static void add_histogram(cJSON *object, HISTOGRAM *histogram) {
+  unsigned long buckets[STATS_BUCKETS];
+  for(int i = 0; i < STATS_BUCKETS; i++)
+    buckets[i] = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+  unsigned long count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+  unsigned long long total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+  unsigned long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+
+  cJSON_AddNumberToObject(object, "count", count);
+  cJSON_AddNumberToObject(object, "total_ms", total / 1e6);
+  cJSON_AddNumberToObject(object, "mean_ms", count > 0 ? total / 1e6 / count : 0);
+  cJSON_AddNumberToObject(object, "p50_ms", percentile(buckets, count, max, 50));
+  cJSON_AddNumberToObject(object, "p95_ms", percentile(buckets, count, max, 95));
+  cJSON_AddNumberToObject(object, "p99_ms", percentile(buckets, count, max, 99));
+  cJSON_AddNumberToObject(object, "max_ms", max / 1e6);
+}
+
+cJSON* stats_json(const char *const *method_names, int methods_num) {
+  cJSON *result = cJSON_CreateObject();
+  cJSON *stages = cJSON_AddObjectToObject(result, "stages");
+  for(int i = 0; i < STAGES_NUM; i++)
+    add_histogram(cJSON_AddObjectToObject(stages, stage_names[i]), &stage_stats[i]);
+
+  unsigned long long messages_in = 0, bytes_in = 0, messages_out = 0, bytes_out = 0;
+  cJSON *methods = cJSON_AddObjectToObject(result, "methods");
+  for(int i = 0; i < STATS_METHODS_LENGTH; i++) {
+    if(i >= methods_num && i != STATS_OTHER_METHOD)
+      continue;
+    METHOD_STATS *method = &method_stats[i];
+    unsigned long method_messages_in = atomic_load_explicit(&method->messages_in, memory_order_relaxed);
+    unsigned long long method_bytes_in = atomic_load_explicit(&method->bytes_in, memory_order_relaxed);
+    unsigned long method_messages_out = atomic_load_explicit(&method->messages_out, memory_order_relaxed);
+    unsigned long long method_bytes_out = atomic_load_explicit(&method->bytes_out, memory_order_relaxed);
+    messages_in += method_messages_in;
+    bytes_in += method_bytes_in;
+    messages_out += method_messages_out;
+    bytes_out += method_bytes_out;
+    if(method_messages_in == 0 && method_messages_out == 0)
+      continue;
+
+    cJSON *method_json = cJSON_AddObjectToObject(methods,
+        i == STATS_OTHER_METHOD ? "(other)" : method_names[i]);
+    cJSON_AddNumberToObject(method_json, "messages_in", method_messages_in);
+    cJSON_AddNumberToObject(method_json, "bytes_in", method_bytes_in);
+    cJSON_AddNumberToObject(method_json, "messages_out", method_messages_out);
+    cJSON_AddNumberToObject(method_json, "bytes_out", method_bytes_out);
+    add_histogram(method_json, &method->latency);
+  }
+  cJSON_AddNumberToObject(result, "messages_in", messages_in);
+  cJSON_AddNumberToObject(result, "bytes_in", bytes_in);
+  cJSON_AddNumberToObject(result, "messages_out", messages_out);
+  cJSON_AddNumberToObject(result, "bytes_out", bytes_out);
+  return result;
+}
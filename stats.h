@@ -0,0 +1,62 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <cjson/cJSON.h>
+
+// Histogram buckets: bucket `i` counts durations below 2^(i+1) microseconds
+#define STATS_BUCKETS 32
+// Methods counted separately; the last slot counts everything else
+#define STATS_METHODS_LENGTH 32
+#define STATS_OTHER_METHOD (STATS_METHODS_LENGTH - 1)
+
+// Timed stages of the message pipeline
+enum stats_stage {
+  STAGE_READ,             // Message body read from stdin
+  STAGE_DECODE,           // Message body parsed by cJSON
+  STAGE_DISPATCH,         // Message handled by its method
+  STAGE_LEX,              // Tokens lexed again
+  STAGE_PARSE,            // Tokens parsed and checked
+  STAGE_LOOKUP,           // Symbol searched for a cursor query
+  STAGE_SERIALIZE,        // Message printed by cJSON
+  STAGE_WRITE,            // Messages written to stdout
+  STAGES_NUM
+};
+
+/*
+ * Returns nanoseconds elapsed since an arbitrary point (monotonic clock).
+ */
+long long stats_now(void);
+
+/*
+ * Opens a trace file, to which every timed stage and handled message
+ * is written as a line of JSON.
+ * The trace never goes to stdout, which carries the protocol.
+ */
+void stats_open_trace(const char *path);
+
+/*
+ * Records a stage which began at `start` (see `stats_now`) and ended now.
+ */
+void stats_stage(enum stats_stage stage, long long start);
+
+/*
+ * Records handling of a message of method at `method` slot (or STATS_OTHER_METHOD),
+ * named `name`, which began at `start` and ended now.
+ * `id` is -1 for notifications.
+ */
+void stats_method(int method, const char *name, int id, long long start);
+
+/*
+ * Adds `bytes` of a message read or written to the counters of `method` slot.
+ */
+void stats_bytes_in(int method, size_t bytes);
+void stats_bytes_out(int method, size_t bytes);
+
+/*
+ * Returns all counters and histograms as a JSON object.
+ * Methods are named by `method_names`, with `methods_num` elements.
+ */
+cJSON* stats_json(const char *const *method_names, int methods_num);
+
+#endif /* end of include guard: STATS_H */
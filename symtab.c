@@ -4,73 +4,112 @@
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
 #include "defs.h"
+#include "err_codes.h"
 #include "symtab.h"
 
-SYMBOL_ENTRY symbol_table[SYMBOL_TABLE_LENGTH];
-int first_empty = 0;
+// Returns bucket of a symbol name (capacity is a power of two).
+// Names are interned, so their addresses are hashed.
+static int* bucket(SYMTAB *symtab, const char *name) {
+  uintptr_t address = (uintptr_t) name;
+  return &symtab->buckets[((address >> 4) ^ (address >> 12)) & (symtab->capacity - 1)];
+}
 
-int get_next_empty_element(void) {
-  if(first_empty < SYMBOL_TABLE_LENGTH)
-    return first_empty++;
-  else {
-    err("Compiler error! Symbol table overflow!");
-    exit(EXIT_FAILURE);
+// Doubles capacity of the table, and rebuilds the hash chains.
+static void grow_symtab(SYMTAB *symtab) {
+  int capacity = symtab->capacity ? symtab->capacity * 2 : SYMBOL_TABLE_LENGTH;
+  SYMBOL_ENTRY *table = realloc(symtab->table, capacity * sizeof(SYMBOL_ENTRY));
+  int *chain = realloc(symtab->chain, capacity * sizeof(int));
+  int *buckets = realloc(symtab->buckets, capacity * sizeof(int));
+  if(table == NULL || chain == NULL || buckets == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  symtab->table = table;
+  symtab->chain = chain;
+  symtab->buckets = buckets;
+  symtab->capacity = capacity;
+
+  for(int i = 0; i < capacity; i++)
+    symtab->buckets[i] = -1;
+  for(int i = 0; i < symtab->first_empty; i++) {
+    int *head = bucket(symtab, symtab->table[i].name);
+    symtab->chain[i] = *head;
+    *head = i;
   }
 }
 
-int get_last_element(void) {
-  return first_empty-1;
+int get_next_empty_element(SYMTAB *symtab) {
+  if(symtab->first_empty == symtab->capacity)
+    grow_symtab(symtab);
+  return symtab->first_empty++;
+}
+
+int get_last_element(SYMTAB *symtab) {
+  return symtab->first_empty-1;
 }
 
-int insert_symbol(char *name,
+int insert_symbol(SYMTAB *symtab, char *name,
     unsigned kind,
     unsigned type,
     unsigned atr1,
     unsigned atr2,
     SYMBOL_RANGE range) {
-  int index = get_next_empty_element();
-  symbol_table[index].name = name;
-  symbol_table[index].kind = kind;
-  symbol_table[index].type = type;
-  symbol_table[index].atr1 = atr1;
-  symbol_table[index].atr2 = atr2;
-  symbol_table[index].range = range;
+  int index = get_next_empty_element(symtab);
+  int *head = bucket(symtab, name);
+  symtab->chain[index] = *head;
+  *head = index;
+  symtab->table[index].name = name;
+  symtab->table[index].kind = kind;
+  symtab->table[index].type = type;
+  symtab->table[index].atr1 = atr1;
+  symtab->table[index].atr2 = atr2;
+  symtab->table[index].range = range;
   return index;
 }
 
-int insert_literal(char *str, unsigned type) {
-  int idx;
-  for(idx = first_empty - 1; idx > FUN_REG; idx--) {
-    if(strcmp(symbol_table[idx].name, str) == 0
-       && symbol_table[idx].type == type)
+int lookup_literal(SYMTAB *symtab, const char *str, unsigned type) {
+  if(symtab->capacity == 0)
+    return -1;
+  for(int idx = *bucket(symtab, str); idx > FUN_REG; idx = symtab->chain[idx]) {
+    if(symtab->table[idx].name == str
+       && symtab->table[idx].type == type)
        return idx;
   }
+  return -1;
+}
+
+int insert_literal(SYMTAB *symtab, char *str, unsigned type) {
+  int idx = lookup_literal(symtab, str, type);
+  if(idx != -1)
+    return idx;
 
-  // check literal range
-  long int num = atol(str);
-  if(((type==INT) && (num<INT_MIN || num>INT_MAX) )
-    || ((type==UINT) && (num<0 || num>UINT_MAX)) )
-      err("literal out of range");
   SYMBOL_RANGE no_range = NO_RANGE;
-  idx = insert_symbol(str, LIT, type, NO_ATR, NO_ATR, no_range);
+  idx = insert_symbol(symtab, str, LIT, type, NO_ATR, NO_ATR, no_range);
   return idx;
 }
 
-int lookup_symbol(const char *name, unsigned kind) {
+int literal_in_range(const char *str, unsigned type) {
+  long int num = atol(str);
+  return !(((type==INT) && (num<INT_MIN || num>INT_MAX) )
+    || ((type==UINT) && (num<0 || num>UINT_MAX)) );
+}
+
+int lookup_symbol(SYMTAB *symtab, const char *name, unsigned kind) {
   int i;
-  for(i = first_empty - 1; i > FUN_REG; i--) {
-    if(strcmp(symbol_table[i].name, name) == 0
-       && symbol_table[i].kind & kind)
+  if(symtab->capacity == 0)
+    return -1;
+  for(i = *bucket(symtab, name); i > FUN_REG; i = symtab->chain[i]) {
+    if(symtab->table[i].name == name
+       && symtab->table[i].kind & kind)
        return i;
   }
   return -1;
 }
 
-int lookup_starts_with(int *results, const char *name_part) {
+int lookup_starts_with(SYMTAB *symtab, int *results, const char *name_part) {
   int found_num = 0;
-  for(int i = first_empty - 1; i > FUN_REG; i--) {
-    const char *symbol_name = symbol_table[i].name;
+  for(int i = symtab->first_empty - 1; i > FUN_REG; i--) {
+    const char *symbol_name = symtab->table[i].name;
     if(strstr(symbol_name, name_part) == symbol_name) {
       results[found_num] = i;
       ++found_num;
@@ -79,82 +118,90 @@ int lookup_starts_with(int *results, const char *name_part) {
   return found_num;
 }
 
-void set_name(int index, char *name) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    symbol_table[index].name = name;
+void set_name(SYMTAB *symtab, int index, char *name) {
+  if(index > -1 && index < symtab->first_empty)
+    symtab->table[index].name = name;
 }
 
-char *get_name(int index) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    return symbol_table[index].name;
+char *get_name(SYMTAB *symtab, int index) {
+  if(index > -1 && index < symtab->first_empty)
+    return symtab->table[index].name;
   return "?";
 }
 
-void set_kind(int index, unsigned kind) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    symbol_table[index].kind = kind;
+void set_kind(SYMTAB *symtab, int index, unsigned kind) {
+  if(index > -1 && index < symtab->first_empty)
+    symtab->table[index].kind = kind;
 }
 
-unsigned get_kind(int index) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    return symbol_table[index].kind;
+unsigned get_kind(SYMTAB *symtab, int index) {
+  if(index > -1 && index < symtab->first_empty)
+    return symtab->table[index].kind;
   return NO_KIND;
 }
 
-void set_type(int index, unsigned type) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    symbol_table[index].type = type;
+void set_type(SYMTAB *symtab, int index, unsigned type) {
+  if(index > -1 && index < symtab->first_empty)
+    symtab->table[index].type = type;
 }
 
-unsigned get_type(int index) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    return symbol_table[index].type;
+unsigned get_type(SYMTAB *symtab, int index) {
+  if(index > -1 && index < symtab->first_empty)
+    return symtab->table[index].type;
   return NO_TYPE;
 }
 
-void set_atr1(int index, unsigned atr1) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    symbol_table[index].atr1 = atr1;
+void set_atr1(SYMTAB *symtab, int index, unsigned atr1) {
+  if(index > -1 && index < symtab->first_empty)
+    symtab->table[index].atr1 = atr1;
 }
 
-unsigned get_atr1(int index) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    return symbol_table[index].atr1;
+unsigned get_atr1(SYMTAB *symtab, int index) {
+  if(index > -1 && index < symtab->first_empty)
+    return symtab->table[index].atr1;
   return NO_ATR;
 }
 
-void set_atr2(int index, unsigned atr2) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    symbol_table[index].atr2 = atr2;
+void set_atr2(SYMTAB *symtab, int index, unsigned atr2) {
+  if(index > -1 && index < symtab->first_empty)
+    symtab->table[index].atr2 = atr2;
 }
 
-unsigned get_atr2(int index) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    return symbol_table[index].atr2;
+unsigned get_atr2(SYMTAB *symtab, int index) {
+  if(index > -1 && index < symtab->first_empty)
+    return symtab->table[index].atr2;
   return NO_ATR;
 }
 
-void set_range(int index, SYMBOL_RANGE range) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    symbol_table[index].range = range;
+void set_range(SYMTAB *symtab, int index, SYMBOL_RANGE range) {
+  if(index > -1 && index < symtab->first_empty)
+    symtab->table[index].range = range;
 }
 
-SYMBOL_RANGE get_range(int index) {
-  if(index > -1 && index < SYMBOL_TABLE_LENGTH)
-    return symbol_table[index].range;
+SYMBOL_RANGE get_range(SYMTAB *symtab, int index) {
+  if(index > -1 && index < symtab->first_empty)
+    return symtab->table[index].range;
   SYMBOL_RANGE no_range = NO_RANGE;
   return no_range;
 }
 
-char* get_display(int index) {
+char* get_display(SYMTAB *symtab, int index) {
+  SYMBOL_ENTRY entry = {
+    get_name(symtab, index), get_kind(symtab, index), get_type(symtab, index),
+    get_atr1(symtab, index), get_atr2(symtab, index), get_range(symtab, index)
+  };
+  return entry_display(&entry);
+}
+
+char* entry_display(const SYMBOL_ENTRY *entry) {
   const char *types_str[] = { "void", "int", "unsigned int" };
 
-  const char *type = types_str[get_type(index)];
-  const char *name = get_name(index);
+  const char *type = types_str[entry->type];
+  const char *name = entry->name;
   const char *par_type = "";
-  if(get_kind(index) == FUN) {
-    if(get_atr1(index) == 1) {
-      par_type = types_str[get_atr2(index)];
+  if(entry->kind == FUN) {
+    if(entry->atr1 == 1) {
+      par_type = types_str[entry->atr2];
     }
   }
 
@@ -162,7 +209,7 @@ char* get_display(int index) {
   strcpy(display, type);
   strcat(display, " ");
   strcat(display, name);
-  if(get_kind(index) == FUN) {
+  if(entry->kind == FUN) {
     strcat(display, "(");
     strcat(display, par_type);
     strcat(display, ")");
@@ -170,47 +217,46 @@ char* get_display(int index) {
   return display;
 }
 
-void clear_symbols(int begin_index) {
+void clear_symbols(SYMTAB *symtab, int begin_index) {
   int i;
-  if(begin_index == first_empty) // Already empty
+  if(begin_index == symtab->first_empty) // Already empty
     return;
-  if(begin_index > first_empty) {
-    err("Compiler error! Wrong clear symbols argument");
+  if(begin_index > symtab->first_empty) {
+    fprintf(stderr, "Compiler error! Wrong clear symbols argument\n");
     exit(EXIT_FAILURE);
   }
-  for(i = begin_index; i < first_empty; i++) {
-    if(symbol_table[i].name)
-      free(symbol_table[i].name);
-    symbol_table[i].name = 0;
-    symbol_table[i].kind = NO_KIND;
-    symbol_table[i].type = NO_TYPE;
-    symbol_table[i].atr1 = NO_ATR;
-    symbol_table[i].atr2 = NO_TYPE;
-    SYMBOL_RANGE no_range = NO_RANGE;
-    symbol_table[i].range = no_range;
+  // Removed entries are the newest ones, so they are the heads of their chains
+  for(i = symtab->first_empty - 1; i >= begin_index; i--) {
+    *bucket(symtab, symtab->table[i].name) = symtab->chain[i];
   }
-  first_empty = begin_index;
+  symtab->first_empty = begin_index;
 }
 
-void clear_symtab(void) {
-  first_empty = SYMBOL_TABLE_LENGTH - 1;
-  clear_symbols(0);
+void clear_symtab(SYMTAB *symtab) {
+  clear_symbols(symtab, 0);
+  free(symtab->table);
+  free(symtab->chain);
+  free(symtab->buckets);
+  symtab->table = NULL;
+  symtab->chain = NULL;
+  symtab->buckets = NULL;
+  symtab->capacity = 0;
 }
 
-void print_symtab(void) {
+void print_symtab(SYMTAB *symtab) {
   static const char *symbol_kinds[] = {
     "NONE", "REG", "LIT", "FUN", "VAR", "PAR" };
   int i;
   printf("\n\nSYMBOL TABLE\n");
   printf("\n       name           kind   type  atr1   atr2");
   printf("\n-- ---------------- -------- ----  -----  -----");
-  for(i = 0; i < first_empty; i++) {
+  for(i = 0; i < symtab->first_empty; i++) {
     printf("\n%2d %-19s %-4s %4d  %4d  %4d ", i,
-    symbol_table[i].name,
-    symbol_kinds[(int)(logarithm2(symbol_table[i].kind))],
-    symbol_table[i].type,
-    symbol_table[i].atr1,
-    symbol_table[i].atr2);
+    symtab->table[i].name,
+    symbol_kinds[(int)(logarithm2(symtab->table[i].kind))],
+    symtab->table[i].type,
+    symtab->table[i].atr1,
+    symtab->table[i].atr2);
   }
   printf("\n\n");
 }
@@ -226,14 +272,16 @@ unsigned logarithm2(unsigned value) {
   return 0;
 }
 
-void init_symtab(void) {
-  clear_symtab();
+void init_symtab(SYMTAB *symtab) {
+  clear_symtab(symtab);
 
+  static char *register_names[FUN_REG + 1] = {
+    "%0", "%1", "%2", "%3", "%4", "%5", "%6",
+    "%7", "%8", "%9", "%10", "%11", "%12", "%13"
+  };
   int i = 0;
-  char s[4];
-  for(i = 0; i < 14; i++) {
-    sprintf(s, "%%%d", i);
+  for(i = 0; i <= FUN_REG; i++) {
     SYMBOL_RANGE no_range = NO_RANGE;
-    insert_symbol(strdup(s), REG, NO_TYPE, NO_ATR, NO_ATR, no_range);
+    insert_symbol(symtab, register_names[i], REG, NO_TYPE, NO_ATR, NO_ATR, no_range);
   }
 }
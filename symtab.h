@@ -1,6 +1,8 @@
 #ifndef SYMTAB_H
 #define SYMTAB_H
 
+#include "defs.h"
+
 typedef struct {
   int first_line;
   int first_column;
@@ -18,18 +20,31 @@ typedef struct sym_entry {
   SYMBOL_RANGE range;     // Text range of symbol definition
 } SYMBOL_ENTRY;
 
-// Returns index of the first empty element.
-int get_next_empty_element(void);
+// Symbol table
+// Entries are kept in order of insertion. Entries with names of the same
+// hash are chained from the newest to the oldest, so the first match in
+// a chain is the innermost (shadowing) definition.
+// Names must be interned (see `arena_intern`): they are compared by address,
+// and the table doesn't free them.
+typedef struct {
+  SYMBOL_ENTRY *table;
+  int *chain;             // Index of the previous entry in the same bucket, or -1
+  int first_empty;
+  int capacity;
+  int *buckets;           // Index of the newest entry per name hash, or -1
+} SYMTAB;
+
+// Returns index of the first empty element, growing the table if it is full.
+int get_next_empty_element(SYMTAB *symtab);
 
 // Returns index of the last occupied element.
-int get_last_element(void);
+int get_last_element(SYMTAB *symtab);
 
 /*
  * Inserts a new symbol (1 row in the table),
  * and returns index of the inserted element.
- * Returns -1 if there is no empty space in the symbol table.
  */
-int insert_symbol(char *name,
+int insert_symbol(SYMTAB *symtab, char *name,
     unsigned kind,
     unsigned type,
     unsigned atr1,
@@ -37,13 +52,19 @@ int insert_symbol(char *name,
     SYMBOL_RANGE range);
 
 // Inserts a literal into the symbol table (if it doesn't already exist).
-int insert_literal(char *str, unsigned type);
+int insert_literal(SYMTAB *symtab, char *str, unsigned type);
+
+// Returns index of a literal (`str` is interned), or -1 if it is not in the table.
+int lookup_literal(SYMTAB *symtab, const char *str, unsigned type);
+
+// Checks if a literal fits in the range of its type.
+int literal_in_range(const char *str, unsigned type);
 
 /*
  * Returns index of the found element.
  * If the element is not found, returns -1.
  */
-int lookup_symbol(const char *name, unsigned kind);
+int lookup_symbol(SYMTAB *symtab, const char *name, unsigned kind);
 
 /*
  * Searches for symbols which names start with `name_part`.
@@ -51,39 +72,40 @@ int lookup_symbol(const char *name, unsigned kind);
  *
  * Return value is number of elements found.
  */
-int lookup_starts_with(int *results, const char *name_part);
+int lookup_starts_with(SYMTAB *symtab, int *results, const char *name_part);
 
 // Setters and getters for element fields.
-void     set_name(int index, char *name);
-char*    get_name(int index);
-void     set_kind(int index, unsigned kind);
-unsigned get_kind(int index);
-void     set_type(int index, unsigned type);
-unsigned get_type(int index);
-void     set_atr1(int index, unsigned atr1);
-unsigned get_atr1(int index);
-void     set_atr2(int index, unsigned atr2);
-unsigned get_atr2(int index);
-void     set_range(int index, SYMBOL_RANGE range);
-SYMBOL_RANGE get_range(int index);
+void     set_name(SYMTAB *symtab, int index, char *name);
+char*    get_name(SYMTAB *symtab, int index);
+void     set_kind(SYMTAB *symtab, int index, unsigned kind);
+unsigned get_kind(SYMTAB *symtab, int index);
+void     set_type(SYMTAB *symtab, int index, unsigned type);
+unsigned get_type(SYMTAB *symtab, int index);
+void     set_atr1(SYMTAB *symtab, int index, unsigned atr1);
+unsigned get_atr1(SYMTAB *symtab, int index);
+void     set_atr2(SYMTAB *symtab, int index, unsigned atr2);
+unsigned get_atr2(SYMTAB *symtab, int index);
+void     set_range(SYMTAB *symtab, int index, SYMBOL_RANGE range);
+SYMBOL_RANGE get_range(SYMTAB *symtab, int index);
 /*
  * Returns display string of a symbol.
  *
  * WARNING: Caller is responsible to free the result.
  */
-char* get_display(int index);
+char* get_display(SYMTAB *symtab, int index);
+char* entry_display(const SYMBOL_ENTRY *entry);
 
 // Removes elements beginning with the specified index.
-void clear_symbols(int begin_index);
+void clear_symbols(SYMTAB *symtab, int begin_index);
 
-// Removes all elements.
-void clear_symtab(void);
+// Removes all elements, and frees the table.
+void clear_symtab(SYMTAB *symtab);
 
 // Prints all elements.
-void print_symtab(void);
+void print_symtab(SYMTAB *symtab);
 unsigned logarithm2(unsigned value);
 
 // Initializes the table of symbols.
-void init_symtab(void);
+void init_symtab(SYMTAB *symtab);
 
 #endif /* end of include guard: SYMTAB_H */
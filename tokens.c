@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <string.h>
+#include "err_codes.h"
+#include "tokens.h"
+
+typedef void* yyscan_t;
+int yylex_init_extra(LEXER_STATE *state, yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+int lex_token(yyscan_t scanner);
+
+static TOKEN* grow(TOKEN *tokens, size_t *capacity, size_t needed) {
+  if(needed <= *capacity)
+    return tokens;
+  size_t new_capacity = *capacity ? *capacity : 256;
+  while(new_capacity < needed)
+    new_capacity *= 2;
+  tokens = realloc(tokens, new_capacity * sizeof(TOKEN));
+  if(tokens == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  *capacity = new_capacity;
+  return tokens;
+}
+
+void tokens_damage(TOKEN_STREAM *stream, size_t start, size_t old_end, size_t new_end) {
+  if(!stream->lexed)
+    return;
+  if(!stream->damaged) {
+    stream->damaged = 1;
+    stream->damage_start = start;
+    stream->damage_old_end = old_end;
+    stream->damage_new_end = new_end;
+    return;
+  }
+
+  // Merged with the previous damage: text after both of them is unchanged
+  size_t suffix = old_end > stream->damage_new_end ? old_end : stream->damage_new_end;
+  if(start < stream->damage_start)
+    stream->damage_start = start;
+  stream->damage_old_end += suffix - stream->damage_new_end;
+  stream->damage_new_end = suffix - old_end + new_end;
+}
+
+void tokens_invalidate(TOKEN_STREAM *stream) {
+  stream->lexed = 0;
+  stream->damaged = 0;
+}
+
+// Returns number of tokens ending before `offset`.
+static size_t tokens_before(const TOKEN_STREAM *stream, size_t offset) {
+  size_t low = 0, high = stream->tokens_num;
+  while(low < high) {
+    size_t middle = low + (high - low) / 2;
+    if(stream->tokens[middle].offset + stream->tokens[middle].length < offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+void tokens_sync(TOKEN_STREAM *stream, const char *text, size_t length) {
+  if(!stream->lexed) {
+    stream->tokens_num = 0;
+    stream->damage_start = stream->damage_old_end = 0;
+    stream->damage_new_end = length;
+  }
+  else if(!stream->damaged) {
+    return;
+  }
+  size_t old_end = stream->damage_old_end;
+  size_t new_end = stream->damage_new_end;
+
+  // Lexing restarts at the last token before the damage,
+  // because the damage may join it with the following text
+  size_t first = tokens_before(stream, stream->damage_start);
+  LEXER_STATE state = { .text = text, .length = length };
+  if(first > 0) {
+    --first;
+    state.offset = stream->tokens[first].offset;
+    state.line = stream->tokens[first].line;
+    state.column = stream->tokens[first].column;
+  }
+  state.input = state.offset;
+
+  yyscan_t scanner;
+  if(yylex_init_extra(&state, &scanner) != 0)
+    exit(EXIT_OUT_OF_MEMORY);
+  TOKEN *lexed = NULL;
+  size_t lexed_num = 0, lexed_capacity = 0;
+  size_t old = first;             // First old token which may still be reused
+  int kind;
+  while((kind = lex_token(scanner)) != 0) {
+    TOKEN *token = &state.token;
+    token->kind = kind;
+    if(token->offset >= new_end) {
+      // Tokens after the damage match the old ones once they start at the same place
+      size_t old_offset = token->offset - new_end + old_end;
+      while(old < stream->tokens_num && stream->tokens[old].offset < old_offset)
+        ++old;
+      if(old < stream->tokens_num && stream->tokens[old].offset == old_offset
+         && stream->tokens[old].kind == token->kind
+         && stream->tokens[old].length == token->length)
+        break;
+    }
+    lexed = grow(lexed, &lexed_capacity, lexed_num + 1);
+    lexed[lexed_num++] = *token;
+  }
+  yylex_destroy(scanner);
+
+  size_t reused = 0;
+  if(kind != 0) {
+    // Reused tokens move by the length change, and those on the line
+    // of the first of them also by the change of its column
+    reused = stream->tokens_num - old;
+    TOKEN *tokens = stream->tokens + old;
+    int line = tokens[0].line;
+    int line_change = state.token.line - line;
+    int column_change = state.token.column - tokens[0].column;
+    for(size_t i = 0; i < reused; i++) {
+      if(tokens[i].line == line)
+        tokens[i].column += column_change;
+      tokens[i].line += line_change;
+      tokens[i].offset = tokens[i].offset - old_end + new_end;
+    }
+  }
+
+  size_t tokens_num = first + lexed_num + reused;
+  stream->tokens = grow(stream->tokens, &stream->tokens_capacity, tokens_num);
+  if(reused > 0)
+    memmove(stream->tokens + first + lexed_num, stream->tokens + stream->tokens_num - reused,
+        reused * sizeof(TOKEN));
+  if(lexed_num > 0)
+    memcpy(stream->tokens + first, lexed, lexed_num * sizeof(TOKEN));
+  stream->tokens_num = tokens_num;
+  stream->lexed = 1;
+  stream->damaged = 0;
+  free(lexed);
+}
+
+void tokens_free(TOKEN_STREAM *stream) {
+  free(stream->tokens);
+  memset(stream, 0, sizeof(TOKEN_STREAM));
+}
@@ -0,0 +1,69 @@
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include <stddef.h>
+
+// Kind of a token of an invalid character (reported by the parser)
+#define TOKEN_INVALID -1
+
+typedef struct {
+  int kind;               // Parser token kind, or TOKEN_INVALID
+  int value;              // Semantic value of type and operator tokens
+  size_t offset;          // Offset of the token in the text
+  size_t length;
+  int line;               // Position of the first character
+  int column;
+} TOKEN;
+
+/*
+ * Tokens of a text, kept in sync with its edits.
+ * Edits only mark the text as damaged, and the damaged region
+ * is lexed again when the tokens are needed.
+ */
+typedef struct {
+  TOKEN *tokens;
+  size_t tokens_num;
+  size_t tokens_capacity;
+  int lexed;              // Tokens belong to the text (apart from the damage)
+  int damaged;
+  size_t damage_start;    // Damaged region: [start, old_end) in the lexed text
+  size_t damage_old_end;  // was replaced by [start, new_end) in the current text
+  size_t damage_new_end;
+} TOKEN_STREAM;
+
+/*
+ * State of the scanner, shared with the flex actions.
+ */
+typedef struct {
+  const char *text;
+  size_t length;
+  size_t input;           // Offset of text not read by the scanner yet
+  TOKEN token;            // Last matched token
+  size_t offset;          // Position after the last match
+  int line;
+  int column;
+} LEXER_STATE;
+
+/*
+ * Marks text between `start` and `old_end` as replaced by text ending at `new_end`.
+ */
+void tokens_damage(TOKEN_STREAM *stream, size_t start, size_t old_end, size_t new_end);
+
+/*
+ * Marks the whole text as replaced.
+ */
+void tokens_invalidate(TOKEN_STREAM *stream);
+
+/*
+ * Brings the tokens in sync with the first `length` characters of `text`.
+ * Only the damaged region is lexed, up to the first token
+ * which starts at the same place as before the edit.
+ */
+void tokens_sync(TOKEN_STREAM *stream, const char *text, size_t length);
+
+/*
+ * Frees all tokens of a stream.
+ */
+void tokens_free(TOKEN_STREAM *stream);
+
+#endif /* end of include guard: TOKENS_H */
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "err_codes.h"
+#include "worker.h"
+
+typedef struct task {
+  TASK_FUNCTION function;
+  void *argument;
+  long long due;          // Monotonic time the task can start at
+  struct task *next;
+} TASK;
+
+// Tasks ordered by due time, and by submission for equal due times
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_ready;
+TASK *queue_head;
+int workers_num;
+// Background tasks in submission order, started only when no other task is due
+TASK *background_head;
+TASK *background_tail;
+int background_running;
+
+long long monotonic_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Returns whether another background task may start. One worker is left
+// for other tasks, unless there is only one.
+static int background_allowed(void) {
+  return background_head != NULL
+    && (background_running == 0 || background_running < workers_num - 1);
+}
+
+static void* worker_loop(void *argument) {
+  (void) argument;
+  pthread_mutex_lock(&queue_lock);
+  for(;;) {
+    TASK *task = NULL;
+    int background = 0;
+    if(queue_head != NULL && queue_head->due <= monotonic_time()) {
+      task = queue_head;
+      queue_head = task->next;
+    } else if(background_allowed()) {
+      task = background_head;
+      background_head = task->next;
+      if(background_head == NULL)
+        background_tail = NULL;
+      background = 1;
+      ++background_running;
+    } else if(queue_head != NULL) {
+      long long due = queue_head->due;
+      struct timespec deadline = { due / 1000, due % 1000 * 1000000 };
+      pthread_cond_timedwait(&queue_ready, &queue_lock, &deadline);
+      continue;
+    } else {
+      pthread_cond_wait(&queue_ready, &queue_lock);
+      continue;
+    }
+
+    if(queue_head != NULL || background_allowed()) // Let another worker wait for the next task
+      pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+
+    task->function(task->argument);
+    free(task);
+    pthread_mutex_lock(&queue_lock);
+    if(background) {
+      --background_running;
+      if(background_head != NULL)
+        pthread_cond_signal(&queue_ready);
+    }
+  }
+  return NULL;
+}
+
+void worker_start(int threads_num) {
+  if(threads_num <= 0)
+    threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+  if(threads_num <= 0)
+    threads_num = 1;
+
+  pthread_condattr_t ready_attributes;
+  pthread_condattr_init(&ready_attributes);
+  pthread_condattr_setclock(&ready_attributes, CLOCK_MONOTONIC);
+  pthread_cond_init(&queue_ready, &ready_attributes);
+  pthread_condattr_destroy(&ready_attributes);
+
+  for(int i = 0; i < threads_num; i++) {
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, worker_loop, NULL) != 0)
+      break;
+    pthread_detach(thread);
+    pthread_mutex_lock(&queue_lock);
+    ++workers_num;
+    pthread_mutex_unlock(&queue_lock);
+  }
+}
+
+void worker_submit(TASK_FUNCTION function, void *argument) {
+  worker_schedule(function, argument, 0);
+}
+
+void worker_schedule(TASK_FUNCTION function, void *argument, long delay) {
+  pthread_mutex_lock(&queue_lock);
+  if(workers_num == 0) {
+    pthread_mutex_unlock(&queue_lock);
+    if(delay > 0) {
+      struct timespec duration = { delay / 1000, delay % 1000 * 1000000 };
+      nanosleep(&duration, NULL);
+    }
+    function(argument);
+    return;
+  }
+
+  TASK *task = malloc(sizeof(TASK));
+  if(task == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  task->function = function;
+  task->argument = argument;
+  task->due = monotonic_time() + (delay > 0 ? delay : 0);
+
+  TASK **slot = &queue_head;
+  while(*slot != NULL && (*slot)->due <= task->due) {
+    slot = &(*slot)->next;
+  }
+  task->next = *slot;
+  *slot = task;
+  pthread_cond_signal(&queue_ready);
+  pthread_mutex_unlock(&queue_lock);
+}
+
+void worker_background(TASK_FUNCTION function, void *argument) {
+  pthread_mutex_lock(&queue_lock);
+  if(workers_num == 0) {
+    pthread_mutex_unlock(&queue_lock);
+    function(argument);
+    return;
+  }
+
+  TASK *task = malloc(sizeof(TASK));
+  if(task == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  task->function = function;
+  task->argument = argument;
+  task->due = 0;
+  task->next = NULL;
+  if(background_tail != NULL)
+    background_tail->next = task;
+  else
+    background_head = task;
+  background_tail = task;
+  pthread_cond_signal(&queue_ready);
+  pthread_mutex_unlock(&queue_lock);
+}
@@ -0,0 +1,41 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+typedef void (*TASK_FUNCTION)(void *argument);
+
+/*
+ * Starts a pool of worker threads.
+ * If `threads_num` is not positive, one thread per online CPU is started.
+ */
+void worker_start(int threads_num);
+
+/*
+ * Queues `function` to be called with `argument` on a worker thread.
+ * Tasks are started in the order they were submitted.
+ *
+ * If the pool is not started, the task is run immediately.
+ */
+void worker_submit(TASK_FUNCTION function, void *argument);
+
+/*
+ * Queues a task which is started no sooner than `delay` milliseconds from now.
+ *
+ * If the pool is not started, the calling thread sleeps and runs the task.
+ */
+void worker_schedule(TASK_FUNCTION function, void *argument, long delay);
+
+/*
+ * Queues a low priority task, which is started only when no other task is due.
+ * Background tasks are started in the order they were submitted, and never
+ * occupy every worker, unless the pool has a single one.
+ *
+ * If the pool is not started, the task is run immediately.
+ */
+void worker_background(TASK_FUNCTION function, void *argument);
+
+/*
+ * Returns milliseconds elapsed since an arbitrary point (monotonic clock).
+ */
+long long monotonic_time(void);
+
+#endif /* end of include guard: WORKER_H */
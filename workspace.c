@@ -0,0 +1,561 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "defs.h"
+#include "err_codes.h"
+#include "hash.h"
+#include "io.h"
+#include "lsp.h"
+#include "minic.h"
+#include "stats.h"
+#include "worker.h"
+#include "workspace.h"
+
+#define CACHE_MAGIC "MCIX"
+#define CACHE_VERSION 2
+#define SYMBOL_KIND_FUNCTION 12
+
+// Layout of the cache file: header, files, symbols, and strings
+// (zero-terminated, referred to by their offsets).
+typedef struct {
+  char magic[4];
+  unsigned version;
+  unsigned files_num;
+  unsigned symbols_num;
+  unsigned strings_length;
+  unsigned reserved;      // Aligns the files
+} CACHE_HEADER;
+
+typedef struct {
+  unsigned uri;
+  unsigned symbols_begin;
+  unsigned symbols_num;
+  unsigned reserved;
+  long long mtime;
+  long long size;
+  unsigned long long hash;
+} CACHE_FILE;
+
+typedef struct {
+  unsigned name;
+  unsigned type;
+  unsigned atr1;
+  unsigned atr2;
+  SYMBOL_RANGE range;
+} CACHE_SYMBOL;
+
+// File to be indexed by a worker thread
+typedef struct {
+  int index;              // Index of the file in `workspace_files`
+  char *path;
+} INDEX_TASK;
+
+// Guards everything below
+pthread_mutex_t workspace_lock = PTHREAD_MUTEX_INITIALIZER;
+char *workspace_root;
+WORKSPACE_FILE *workspace_files;
+int workspace_files_num;
+int workspace_files_capacity;
+int workspace_cached_num;     // First files, loaded from the cache and sorted by uri
+int workspace_pending;        // Walk and index tasks which are not finished
+int workspace_changed;        // Index differs from the cache
+// Mapping of the cache file, which names of cached symbols point into
+void *cache_mapping;
+size_t cache_mapping_size;
+
+static int compare_files(const void *a, const void *b) {
+  return strcmp(((const WORKSPACE_FILE*) a)->uri, ((const WORKSPACE_FILE*) b)->uri);
+}
+
+static void free_file(WORKSPACE_FILE *file) {
+  free(file->uri);
+  free(file->symbols);
+  free(file->strings);
+}
+
+// Appends a file with `uri` to the index, and returns its index.
+static int add_file(const char *uri) {
+  if(workspace_files_num == workspace_files_capacity) {
+    workspace_files_capacity = workspace_files_capacity ? workspace_files_capacity * 2 : 64;
+    workspace_files = realloc(workspace_files, workspace_files_capacity * sizeof(WORKSPACE_FILE));
+    if(workspace_files == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+  }
+  WORKSPACE_FILE *file = &workspace_files[workspace_files_num];
+  memset(file, 0, sizeof(WORKSPACE_FILE));
+  file->uri = strdup(uri);
+  if(file->uri == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  return workspace_files_num++;
+}
+
+char* workspace_cache_path(const char *root) {
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char directory[4096];
+  if(cache_home != NULL && cache_home[0] != '\0')
+    snprintf(directory, sizeof(directory), "%s", cache_home);
+  else if(home != NULL)
+    snprintf(directory, sizeof(directory), "%s/.cache", home);
+  else
+    return NULL;
+  mkdir(directory, 0755);
+  strncat(directory, "/minic-lsp", sizeof(directory) - strlen(directory) - 1);
+  mkdir(directory, 0755);
+
+  char *path = malloc(strlen(directory) + 32);
+  if(path == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  sprintf(path, "%s/%016lx.idx", directory, hash_string(root));
+  return path;
+}
+
+// Loads files from the cache file at `path`, if it exists and is valid.
+static void load_cache(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return;
+  struct stat st;
+  if(fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(CACHE_HEADER)) {
+    close(fd);
+    return;
+  }
+  void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED)
+    return;
+
+  const CACHE_HEADER *header = mapping;
+  const CACHE_FILE *files = (const CACHE_FILE*) (header + 1);
+  const CACHE_SYMBOL *symbols = (const CACHE_SYMBOL*) (files + header->files_num);
+  const char *strings = (const char*) (symbols + header->symbols_num);
+  if(memcmp(header->magic, CACHE_MAGIC, 4) != 0
+     || header->version != CACHE_VERSION
+     || (size_t) st.st_size != sizeof(CACHE_HEADER)
+        + (size_t) header->files_num * sizeof(CACHE_FILE)
+        + (size_t) header->symbols_num * sizeof(CACHE_SYMBOL)
+        + header->strings_length
+     || header->strings_length == 0
+     || strings[header->strings_length - 1] != '\0') {
+    munmap(mapping, st.st_size);
+    return;
+  }
+  for(unsigned i = 0; i < header->files_num; i++) {
+    if(files[i].uri >= header->strings_length
+       || files[i].symbols_begin > header->symbols_num
+       || files[i].symbols_num > header->symbols_num - files[i].symbols_begin) {
+      munmap(mapping, st.st_size);
+      return;
+    }
+  }
+
+  cache_mapping = mapping;
+  cache_mapping_size = st.st_size;
+  for(unsigned i = 0; i < header->files_num; i++) {
+    int index = add_file(strings + files[i].uri);
+    WORKSPACE_FILE *file = &workspace_files[index];
+    file->mtime = files[i].mtime;
+    file->size = files[i].size;
+    file->hash = files[i].hash;
+    file->symbols = malloc((files[i].symbols_num + 1) * sizeof(SYMBOL_ENTRY));
+    if(file->symbols == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+    for(unsigned j = 0; j < files[i].symbols_num; j++) {
+      const CACHE_SYMBOL *symbol = &symbols[files[i].symbols_begin + j];
+      if(symbol->name >= header->strings_length)
+        continue;
+      SYMBOL_ENTRY *entry = &file->symbols[file->symbols_num++];
+      // Names are not copied, the mapping is kept
+      entry->name = (char*) strings + symbol->name;
+      entry->kind = FUN;
+      entry->type = symbol->type;
+      entry->atr1 = symbol->atr1;
+      entry->atr2 = symbol->atr2;
+      entry->range = symbol->range;
+    }
+  }
+  // Files are saved sorted by uri
+  if(workspace_files_num > 1)
+    qsort(workspace_files, workspace_files_num, sizeof(WORKSPACE_FILE), compare_files);
+  workspace_cached_num = workspace_files_num;
+}
+
+// Saves all files to the cache file at `path`.
+static void save_cache(const char *path) {
+  CACHE_HEADER header = { CACHE_MAGIC, CACHE_VERSION, workspace_files_num, 0, 0, 0 };
+  for(int i = 0; i < workspace_files_num; i++) {
+    header.symbols_num += workspace_files[i].symbols_num;
+    header.strings_length += strlen(workspace_files[i].uri) + 1;
+    for(int j = 0; j < workspace_files[i].symbols_num; j++)
+      header.strings_length += strlen(workspace_files[i].symbols[j].name) + 1;
+  }
+  size_t size = sizeof(CACHE_HEADER)
+    + header.files_num * sizeof(CACHE_FILE)
+    + header.symbols_num * sizeof(CACHE_SYMBOL)
+    + header.strings_length;
+  char *data = calloc(1, size);
+  if(data == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+
+  memcpy(data, &header, sizeof(CACHE_HEADER));
+  CACHE_FILE *files = (CACHE_FILE*) (data + sizeof(CACHE_HEADER));
+  CACHE_SYMBOL *symbols = (CACHE_SYMBOL*) (files + header.files_num);
+  char *strings = (char*) (symbols + header.symbols_num);
+  unsigned symbols_num = 0;
+  unsigned strings_length = 0;
+  for(int i = 0; i < workspace_files_num; i++) {
+    const WORKSPACE_FILE *file = &workspace_files[i];
+    files[i].uri = strings_length;
+    strcpy(strings + strings_length, file->uri);
+    strings_length += strlen(file->uri) + 1;
+    files[i].symbols_begin = symbols_num;
+    files[i].symbols_num = file->symbols_num;
+    files[i].mtime = file->mtime;
+    files[i].size = file->size;
+    files[i].hash = file->hash;
+    for(int j = 0; j < file->symbols_num; j++) {
+      const SYMBOL_ENTRY *entry = &file->symbols[j];
+      CACHE_SYMBOL *symbol = &symbols[symbols_num++];
+      symbol->name = strings_length;
+      strcpy(strings + strings_length, entry->name);
+      strings_length += strlen(entry->name) + 1;
+      symbol->type = entry->type;
+      symbol->atr1 = entry->atr1;
+      symbol->atr2 = entry->atr2;
+      symbol->range = entry->range;
+    }
+  }
+
+  // Replaced atomically, so a reader never sees a partial file
+  char *temporary_path = malloc(strlen(path) + 5);
+  if(temporary_path == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  sprintf(temporary_path, "%s.tmp", path);
+  FILE *output = fopen(temporary_path, "wb");
+  if(output != NULL) {
+    int written = fwrite(data, 1, size, output) == size;
+    if(fclose(output) == 0 && written)
+      rename(temporary_path, path);
+    else
+      remove(temporary_path);
+  }
+  free(temporary_path);
+  free(data);
+}
+
+// Called when a walk or index task finishes.
+// After the last one, forgets files which were not found, and saves the cache.
+static void finish_task(void) {
+  pthread_mutex_lock(&workspace_lock);
+  if(--workspace_pending > 0) {
+    pthread_mutex_unlock(&workspace_lock);
+    return;
+  }
+
+  int files_num = 0;
+  for(int i = 0; i < workspace_files_num; i++) {
+    if(workspace_files[i].seen)
+      workspace_files[files_num++] = workspace_files[i];
+    else {
+      free_file(&workspace_files[i]);
+      workspace_changed = 1;
+    }
+  }
+  workspace_files_num = files_num;
+  if(workspace_files_num > 1)
+    qsort(workspace_files, workspace_files_num, sizeof(WORKSPACE_FILE), compare_files);
+  workspace_cached_num = workspace_files_num;
+
+  if(workspace_changed) {
+    char *path = workspace_cache_path(workspace_root);
+    if(path != NULL)
+      save_cache(path);
+    free(path);
+    workspace_changed = 0;
+  }
+  pthread_mutex_unlock(&workspace_lock);
+}
+
+// Parses a file, and replaces its functions in the index.
+static void index_task(void *argument) {
+  INDEX_TASK *task = argument;
+
+  int fd = open(task->path, O_RDONLY);
+  struct stat st;
+  if(fd == -1 || fstat(fd, &st) == -1) {
+    if(fd != -1)
+      close(fd);
+    free(task->path);
+    free(task);
+    finish_task();
+    return;
+  }
+  const char *text = "";
+  void *mapping = NULL;
+  if(st.st_size > 0) {
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapping != MAP_FAILED)
+      text = mapping;
+    else
+      st.st_size = 0;
+  }
+  close(fd);
+  unsigned long hash = hash_bytes(text, st.st_size);
+
+  pthread_mutex_lock(&workspace_lock);
+  WORKSPACE_FILE *file = &workspace_files[task->index];
+  int unchanged = file->symbols != NULL && file->hash == hash;
+  file->mtime = (long long) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  file->size = st.st_size;
+  // A touched file is hashed again on the next start instead of saving the cache
+  if(!unchanged)
+    workspace_changed = 1;
+  pthread_mutex_unlock(&workspace_lock);
+
+  if(!unchanged) { // Only touched files are not parsed again
+    long long start = stats_now();
+    SNAPSHOT *snapshot = parse(NULL, text, st.st_size, NULL);
+    stats_stage(STAGE_PARSE, start);
+    int symbols_num = 0;
+    size_t strings_length = 0;
+    for(int i = 0; i < snapshot->symbols_num; i++) {
+      if(snapshot->symbols[i].entry.kind == FUN) {
+        ++symbols_num;
+        strings_length += strlen(snapshot->symbols[i].entry.name) + 1;
+      }
+    }
+    SYMBOL_ENTRY *symbols = malloc((symbols_num + 1) * sizeof(SYMBOL_ENTRY));
+    char *strings = malloc(strings_length + 1);
+    if(symbols == NULL || strings == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+    symbols_num = 0;
+    strings_length = 0;
+    for(int i = 0; i < snapshot->symbols_num; i++) {
+      const SYMBOL_ENTRY *entry = &snapshot->symbols[i].entry;
+      if(entry->kind != FUN)
+        continue;
+      symbols[symbols_num] = *entry;
+      symbols[symbols_num].name = strcpy(strings + strings_length, entry->name);
+      strings_length += strlen(entry->name) + 1;
+      ++symbols_num;
+    }
+    snapshot_free(snapshot);
+
+    pthread_mutex_lock(&workspace_lock);
+    file = &workspace_files[task->index];
+    free(file->symbols);
+    free(file->strings);
+    file->symbols = symbols;
+    file->symbols_num = symbols_num;
+    file->strings = strings;
+    file->hash = hash;
+    pthread_mutex_unlock(&workspace_lock);
+  }
+
+  if(mapping != NULL && mapping != MAP_FAILED)
+    munmap(mapping, st.st_size);
+  free(task->path);
+  free(task);
+  finish_task();
+}
+
+// Returns index of the file with `uri`, or -1 if it is not in the index.
+static int find_file(const char *uri) {
+  WORKSPACE_FILE key = { .uri = (char*) uri };
+  WORKSPACE_FILE *file = workspace_cached_num == 0 ? NULL : bsearch(&key, workspace_files,
+      workspace_cached_num, sizeof(WORKSPACE_FILE), compare_files);
+  if(file != NULL)
+    return file - workspace_files;
+  // Files added since the index was sorted
+  for(int i = workspace_cached_num; i < workspace_files_num; i++) {
+    if(strcmp(workspace_files[i].uri, uri) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// Queues a file found by the walk to be indexed, unless it is cached and unchanged.
+static void found_file(const char *path, const struct stat *st) {
+  char *uri = lsp_path_uri(path);
+
+  pthread_mutex_lock(&workspace_lock);
+  int index = find_file(uri);
+  if(index == -1)
+    index = add_file(uri);
+  WORKSPACE_FILE *file = &workspace_files[index];
+  file->seen = 1;
+  long long mtime = (long long) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+  int unchanged = file->symbols != NULL && file->mtime == mtime && file->size == st->st_size;
+  if(!unchanged)
+    ++workspace_pending;
+  pthread_mutex_unlock(&workspace_lock);
+  free(uri);
+
+  if(unchanged)
+    return;
+  INDEX_TASK *task = malloc(sizeof(INDEX_TASK));
+  if(task == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  task->index = index;
+  task->path = strdup(path);
+  if(task->path == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  // Indexing waits for analyses of open documents
+  worker_background(index_task, task);
+}
+
+// Walks a directory recursively, skipping hidden entries.
+static void walk(const char *directory) {
+  DIR *dir = opendir(directory);
+  if(dir == NULL)
+    return;
+  struct dirent *entry;
+  while((entry = readdir(dir)) != NULL) {
+    if(entry->d_name[0] == '.')
+      continue;
+    size_t length = strlen(entry->d_name);
+    char *path = malloc(strlen(directory) + length + 2);
+    if(path == NULL)
+      exit(EXIT_OUT_OF_MEMORY);
+    sprintf(path, "%s/%s", directory, entry->d_name);
+
+    struct stat st;
+    if(lstat(path, &st) == 0) {
+      if(S_ISDIR(st.st_mode))
+        walk(path);
+      else if(S_ISREG(st.st_mode) && length > 3 && strcmp(entry->d_name + length - 3, ".mc") == 0)
+        found_file(path, &st);
+    }
+    free(path);
+  }
+  closedir(dir);
+}
+
+static void walk_task(void *argument) {
+  (void) argument;
+  walk(workspace_root);
+  finish_task();
+}
+
+void workspace_open(const char *root) {
+  pthread_mutex_lock(&workspace_lock);
+  if(workspace_root != NULL) { // Already open
+    pthread_mutex_unlock(&workspace_lock);
+    return;
+  }
+  workspace_root = strdup(root);
+  if(workspace_root == NULL)
+    exit(EXIT_OUT_OF_MEMORY);
+  char *path = workspace_cache_path(root);
+  if(path != NULL)
+    load_cache(path);
+  free(path);
+  workspace_pending = 1; // The walk
+  pthread_mutex_unlock(&workspace_lock);
+
+  worker_background(walk_task, NULL);
+}
+
+void workspace_file_changed(const char *path) {
+  size_t length = strlen(path);
+  if(length <= 3 || strcmp(path + length - 3, ".mc") != 0)
+    return;
+  pthread_mutex_lock(&workspace_lock);
+  size_t root_length = workspace_root != NULL ? strlen(workspace_root) : 0;
+  if(workspace_root == NULL || strncmp(path, workspace_root, root_length) != 0
+     || path[root_length] != '/') {
+    pthread_mutex_unlock(&workspace_lock);
+    return;
+  }
+  pthread_mutex_unlock(&workspace_lock);
+
+  struct stat st;
+  if(stat(path, &st) == 0) {
+    if(S_ISREG(st.st_mode))
+      found_file(path, &st);
+    return;
+  }
+
+  // Deleted file is forgotten once no task refers to it
+  char *uri = lsp_path_uri(path);
+  pthread_mutex_lock(&workspace_lock);
+  int index = find_file(uri);
+  free(uri);
+  if(index == -1) {
+    pthread_mutex_unlock(&workspace_lock);
+    return;
+  }
+  WORKSPACE_FILE *file = &workspace_files[index];
+  free(file->symbols);
+  free(file->strings);
+  file->symbols = NULL;
+  file->symbols_num = 0;
+  file->strings = NULL;
+  file->seen = 0;
+  workspace_changed = 1;
+  ++workspace_pending;
+  pthread_mutex_unlock(&workspace_lock);
+  finish_task();
+}
+
+// Checks if `name` contains characters of `query` in order (case-insensitive).
+static int subsequence(const char *name, const char *query) {
+  for(; *name != '\0' && *query != '\0'; name++) {
+    if(tolower((unsigned char) *name) == tolower((unsigned char) *query))
+      ++query;
+  }
+  return *query == '\0';
+}
+
+// Creates LSP location object.
+static cJSON* location_json(const char *uri, SYMBOL_RANGE range) {
+  cJSON *location = cJSON_CreateObject();
+  cJSON_AddStringToObject(location, "uri", uri);
+  cJSON_AddItemToObject(location, "range", range_json(range));
+  return location;
+}
+
+cJSON* workspace_symbols(const char *query) {
+  cJSON *results = cJSON_CreateArray();
+  int results_num = 0;
+  pthread_mutex_lock(&workspace_lock);
+  for(int i = 0; i < workspace_files_num && results_num < WORKSPACE_SYMBOL_LIMIT; i++) {
+    const WORKSPACE_FILE *file = &workspace_files[i];
+    for(int j = 0; j < file->symbols_num && results_num < WORKSPACE_SYMBOL_LIMIT; j++) {
+      const SYMBOL_ENTRY *entry = &file->symbols[j];
+      if(!subsequence(entry->name, query))
+        continue;
+      cJSON *symbol = cJSON_CreateObject();
+      cJSON_AddStringToObject(symbol, "name", entry->name);
+      cJSON_AddNumberToObject(symbol, "kind", SYMBOL_KIND_FUNCTION);
+      cJSON_AddItemToObject(symbol, "location", location_json(file->uri, entry->range));
+      cJSON_AddItemToArray(results, symbol);
+      ++results_num;
+    }
+  }
+  pthread_mutex_unlock(&workspace_lock);
+  return results;
+}
+
+cJSON* workspace_definition(const char *name) {
+  cJSON *location = NULL;
+  pthread_mutex_lock(&workspace_lock);
+  for(int i = 0; i < workspace_files_num && location == NULL; i++) {
+    const WORKSPACE_FILE *file = &workspace_files[i];
+    for(int j = 0; j < file->symbols_num; j++) {
+      if(strcmp(file->symbols[j].name, name) == 0) {
+        location = location_json(file->uri, file->symbols[j].range);
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&workspace_lock);
+  return location;
+}
@@ -0,0 +1,59 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <cjson/cJSON.h>
+#include "symtab.h"
+
+// Maximum number of results of a workspace symbol search
+#define WORKSPACE_SYMBOL_LIMIT 100
+
+// Indexed source file of the workspace
+typedef struct {
+  char *uri;
+  long long mtime;        // Modification time (ns) when the file was indexed
+  long long size;
+  unsigned long hash;     // Hash of the content when the file was indexed
+  SYMBOL_ENTRY *symbols;  // Functions defined in the file
+  int symbols_num;
+  char *strings;          // Owns names of the symbols, NULL if they are in the cache
+  int seen;               // Found by the current walk of the workspace
+} WORKSPACE_FILE;
+
+/*
+ * Loads the index cache of a workspace with `root` directory,
+ * and starts indexing all .mc files under `root` on worker threads.
+ * Only files which changed since they were cached are parsed again.
+ * The cache is saved when indexing finishes.
+ *
+ * Until then, queries are answered from the cache.
+ */
+void workspace_open(const char *root);
+
+/*
+ * Indexes a file of the workspace again, after it was saved, created or deleted.
+ * Only files which changed since they were indexed are parsed again.
+ * Paths outside of the workspace, and other than .mc files are ignored.
+ */
+void workspace_file_changed(const char *path);
+
+/*
+ * Returns locations of workspace functions, which names contain
+ * characters of `query` in order (case-insensitive), as LSP symbol information.
+ * At most WORKSPACE_SYMBOL_LIMIT functions are returned.
+ */
+cJSON* workspace_symbols(const char *query);
+
+/*
+ * Returns location of a function with `name` defined in the workspace,
+ * or NULL if it is not found.
+ */
+cJSON* workspace_definition(const char *name);
+
+/*
+ * Returns path of the index cache file of `root`.
+ *
+ * WARNING: Caller is responsible to free the result.
+ */
+char* workspace_cache_path(const char *root);
+
+#endif /* end of include guard: WORKSPACE_H */